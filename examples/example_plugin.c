@@ -0,0 +1,76 @@
+/**
+ * Example GEPT plugin. Adds two directives:
+ *
+ *     * @repeat <N> ... @end - expands to N copies of its body. `{i}` in the body is
+ *                              replaced by the index of the copy.
+ *     * @string <file>       - expands to the contents of <file> as a C string literal.
+ *
+ * Build and use:
+ *
+ *     gcc -Iinclude -shared -fPIC examples/example_plugin.c -o example_plugin.so
+ *     ./gept --plugin ./example_plugin.so -i examples/plugin.template
+ */
+
+#define _GNU_SOURCE
+
+#include "gept_plugin.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+GEPT_PLUGIN_DECLARE_ABI();
+
+static int expand_repeat(const GeptApi *api, GeptCall *call, GeptSink *sink)
+{
+    const char *word;
+    size_t length;
+    if (!api->next_word(call, &word, &length)) {
+        return 1;
+    }
+    long n = strtol(word, NULL, 10);
+
+    for (long i = 0; i < n; i++) {
+        const char *p = call->body;
+        const char *end = call->body + call->body_length;
+        while (p < end) {
+            const char *hit = memmem(p, end - p, "{i}", 3);
+            if (hit == NULL) {
+                api->append(sink, p, end - p);
+                break;
+            }
+            api->append(sink, p, hit - p);
+            api->append_fmt(sink, "%ld", i);
+            p = hit + 3;
+        }
+    }
+    return 0;
+}
+
+static int expand_string(const GeptApi *api, GeptCall *call, GeptSink *sink)
+{
+    const char *word;
+    size_t length;
+    char path[4096];
+    if (!api->next_word(call, &word, &length) || length >= sizeof(path)) {
+        return 1;
+    }
+    memcpy(path, word, length);
+    path[length] = '\0';
+
+    const char *data;
+    size_t size;
+    if (!api->map_file(path, &data, &size)) {
+        return 1;
+    }
+    api->append(sink, "    ", 4);
+    api->append_c_string(sink, data, size);
+    api->append(sink, "\n", 1);
+    return 0;
+}
+
+GEPT_PLUGIN_EXPORT int gept_plugin_init(const GeptApi *api)
+{
+    static const GeptDirective repeat = {.name = "@repeat", .is_multiline = true, .expand = expand_repeat};
+    static const GeptDirective string = {.name = "@string", .expand = expand_string};
+    return api->register_directive(api, &repeat) || api->register_directive(api, &string);
+}
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Stand-in for an HTTP remote cache (`--remote-cache`), used by test_remote_cache.sh.
+#
+# Usage: remote_cache_server.py MODE
+#
+# Prints the port it listens on (on 127.0.0.1) and serves until killed. PUT stores the
+# body under the path. GET depends on MODE:
+#   normal   stored entries are returned with a Content-Length, then the connection is
+#            held open for 5 s, so a client which reads until EOF stalls
+#   chunked  stored entries are returned with `Transfer-Encoding: chunked`
+#   trickle  every GET gets a 200 reply sent one byte every 0.3 s
+# Entries which aren't stored get a 404.
+
+import socket
+import sys
+import threading
+import time
+
+mode = sys.argv[1]
+store = {}
+
+
+def handle(conn):
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = conn.recv(65536)
+        if not chunk:
+            conn.close()
+            return
+        data += chunk
+    head, body = data.split(b'\r\n\r\n', 1)
+    lines = head.decode().split('\r\n')
+    method, path, _ = lines[0].split(' ')
+    length = 0
+    for line in lines[1:]:
+        name, _, value = line.partition(':')
+        if name.strip().lower() == 'content-length':
+            length = int(value)
+    while len(body) < length:
+        body += conn.recv(65536)
+
+    if method == 'PUT':
+        store[path] = body
+        conn.sendall(b'HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n')
+    elif mode == 'trickle':
+        for b in b'HTTP/1.1 200 OK\r\nContent-Length: 64\r\n\r\n' + b'a' * 64:
+            conn.sendall(bytes([b]))
+            time.sleep(0.3)
+    elif path in store and mode == 'chunked':
+        value = store[path]
+        conn.sendall(b'HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n%x\r\n' % len(value)
+                     + value + b'\r\n0\r\n\r\n')
+    elif path in store:
+        value = store[path]
+        # header names are case-insensitive
+        conn.sendall(b'HTTP/1.1 200 OK\r\ncontent-length: %d\r\n\r\n' % len(value) + value)
+        time.sleep(5)
+    else:
+        conn.sendall(b'HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n')
+    conn.close()
+
+
+server = socket.socket()
+server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+server.bind(('127.0.0.1', 0))
+server.listen(16)
+print(server.getsockname()[1], flush=True)
+while True:
+    conn, _ = server.accept()
+    threading.Thread(target=handle, args=(conn,), daemon=True).start()
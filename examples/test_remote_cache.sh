@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+# Runs gept against the stand-in remote cache of remote_cache_server.py, checking a
+# miss, a hit, a timeout and a chunked reply (which is treated as a miss).
+#
+# Usage: examples/test_remote_cache.sh [path to gept]    (default ./gept)
+
+set -u
+gept=${1:-./gept}
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+failures=0
+server_pid=
+
+cleanup() {
+    [ -n "$server_pid" ] && kill "$server_pid" 2>/dev/null
+    rm -rf "$tmp"
+}
+trap cleanup EXIT
+
+cat > "$tmp/template" <<'EOF'
+@bash
+echo ran >&2
+echo script output
+@end
+EOF
+
+# starts a server in mode $1 and sets `url`
+start_server() {
+    [ -n "$server_pid" ] && kill "$server_pid" 2>/dev/null
+    rm -f "$tmp/port"
+    python3 "$dir/remote_cache_server.py" "$1" > "$tmp/port" &
+    server_pid=$!
+    while [ ! -s "$tmp/port" ]; do sleep 0.05; done
+    url="http://127.0.0.1:$(cat "$tmp/port")"
+}
+
+# runs gept with the extra arguments, setting `out`, `err` and `ms`
+run() {
+    local start=$(date +%s%N)
+    out=$("$gept" -yolo -i "$tmp/template" --remote-cache "$url" "$@" 2> "$tmp/err")
+    ms=$((($(date +%s%N) - start) / 1000000))
+    err=$(cat "$tmp/err")
+}
+
+# check NAME CONDITION...
+check() {
+    local name=$1
+    shift
+    if "$@"; then
+        echo "ok    $name"
+    else
+        echo "FAIL  $name (stdout: '$out', stderr: '$err', ${ms} ms)"
+        failures=$((failures + 1))
+    fi
+}
+
+ran()       { [[ $err == *ran* ]]; }
+not_ran()   { [[ $err != *ran* ]]; }
+has_output(){ [[ $out == *"script output"* ]]; }
+warned()    { [[ $err == *WARNING* ]]; }
+fast()      { [ "$ms" -lt 3000 ]; }
+
+start_server normal
+run
+check "miss runs the script"         ran
+check "miss output"                  has_output
+run
+check "hit skips the script"         not_ran
+check "hit output"                   has_output
+check "hit stops at Content-Length"  fast
+
+start_server chunked
+run
+run
+check "chunked reply is a miss"      ran
+check "chunked output"               has_output
+
+start_server trickle
+run --remote-cache-timeout 500
+check "timeout warns"                warned
+check "timeout runs the script"      ran
+check "timeout output"               has_output
+check "timeout is bounded"           fast
+
+[ "$failures" -eq 0 ] && echo "all passed" || echo "$failures failed"
+[ "$failures" -eq 0 ]
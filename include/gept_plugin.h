@@ -0,0 +1,183 @@
+
+/**
+ * LICENSE:
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Henrik A. Glass
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ * ABOUT:
+ *
+ * gept_plugin.h defines the ABI between GEPT and plugins: shared objects, loaded
+ * with `--plugin`, which add new directives. Plugin directives are expanded
+ * in-process, without forking or starting an interpreter.
+ *
+ *
+ * USAGE:
+ *
+ * A plugin declares the ABI version it was built against and exports an init
+ * function, which registers the plugin's directives:
+ *
+ *     #include "gept_plugin.h"
+ *
+ *     GEPT_PLUGIN_DECLARE_ABI();
+ *
+ *     static int expand_hello(const GeptApi *api, GeptCall *call, GeptSink *sink)
+ *     {
+ *         const char *name;
+ *         size_t name_length;
+ *         if (!api->next_word(call, &name, &name_length)) {
+ *             return 1; // error: missing argument
+ *         }
+ *         api->append_fmt(sink, "hello, %.*s\n", (int) name_length, name);
+ *         return 0;
+ *     }
+ *
+ *     GEPT_PLUGIN_EXPORT int gept_plugin_init(const GeptApi *api)
+ *     {
+ *         static const GeptDirective hello = {.name = "@hello", .expand = expand_hello};
+ *         return api->register_directive(api, &hello);
+ *     }
+ *
+ * Build it as a shared object and load it with `--plugin`:
+ *
+ *     gcc -Iinclude -shared -fPIC hello.c -o hello.so
+ *     ./gept --plugin ./hello.so -i template
+ *
+ * The expand callback of a directive is called once for every occurrence of the
+ * directive in a template. It returns 0 on success. On failure, GEPT reports the
+ * offending line and exits.
+ *
+ * Arguments are parsed with `next_word` and `next_attribute`, which consume the
+ * arguments of the call from the left. `next_attribute` parses attributes of the
+ * form `name(arg0, "arg 1", ...)`, like GEPT's own directives do.
+ *
+ * Functions may only be added to the end of `GeptApi`, and doing so bumps the
+ * minor version. Any other change bumps the major version. GEPT refuses to load
+ * plugins built against a different major version, or a newer minor version.
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef GEPT_PLUGIN_H
+#define GEPT_PLUGIN_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*--- Public macros ---------------------------------------------------------------------*/
+
+#define GEPT_PLUGIN_ABI_MAJOR 1
+#define GEPT_PLUGIN_ABI_MINOR 0
+#define GEPT_PLUGIN_ABI_VERSION ((GEPT_PLUGIN_ABI_MAJOR << 16) | GEPT_PLUGIN_ABI_MINOR)
+
+#define GEPT_PLUGIN_MAX_ATTRIBUTE_ARGS 4
+
+#define GEPT_PLUGIN_EXPORT __attribute__((visibility("default")))
+
+/* Must appear exactly once in every plugin */
+#define GEPT_PLUGIN_DECLARE_ABI() \
+    GEPT_PLUGIN_EXPORT const uint32_t gept_plugin_abi_version = GEPT_PLUGIN_ABI_VERSION
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+/* Where a directive writes its expansion. Opaque to plugins. */
+typedef struct GeptSink GeptSink;
+
+/* An occurrence of a plugin directive in a template */
+typedef struct {
+    const char *line;        /* the whole directive line */
+    size_t line_length;
+    const char *args;        /* the rest of the line following the directive name */
+    size_t args_length;      /* (consumed by `next_word` and `next_attribute`) */
+    const char *body;        /* for multi-line directives: the lines up to `@end`. Else NULL */
+    size_t body_length;
+    void *user_data;         /* `user_data` of the directive */
+} GeptCall;
+
+/* A parsed attribute, e.g. `name(arg0, arg1)`. Strings are not NULL-terminated */
+typedef struct {
+    const char *name;
+    size_t name_length;
+    const char *args[GEPT_PLUGIN_MAX_ATTRIBUTE_ARGS];
+    size_t args_length[GEPT_PLUGIN_MAX_ATTRIBUTE_ARGS];
+    int n_args;
+} GeptAttribute;
+
+typedef struct GeptApi GeptApi;
+
+typedef struct {
+    const char *name;   /* name of the directive, including the leading `@` */
+    bool is_multiline;  /* the directive takes a body, terminated by `@end` */
+    int (*expand)(const GeptApi *api, GeptCall *call, GeptSink *sink);
+    void *user_data;    /* passed to `expand` in `call->user_data` */
+} GeptDirective;
+
+struct GeptApi {
+    uint32_t abi_version; /* GEPT_PLUGIN_ABI_VERSION of GEPT */
+
+    /* Registers `directive`. Only the pointer is stored, so `directive` must outlive
+     * the plugin. Returns 0 on success */
+    int (*register_directive)(const GeptApi *api, const GeptDirective *directive);
+
+    /* Consumes the next whitespace-separated word of `call->args`. Returns false if
+     * there are no more words */
+    bool (*next_word)(GeptCall *call, const char **word, size_t *length);
+
+    /* Consumes the next attribute of `call->args`. Returns false if there are no
+     * more attributes. Syntax errors are reported by GEPT */
+    bool (*next_attribute)(GeptCall *call, GeptAttribute *attr);
+
+    /* Maps the file at `path` (NULL-terminated). The mapping is shared with GEPT's
+     * own directives and lives until GEPT exits. Returns false if the file can't
+     * be opened */
+    bool (*map_file)(const char *path, const char **data, size_t *size);
+
+    /* Appends `size` bytes of `data` to `sink` */
+    void (*append)(GeptSink *sink, const char *data, size_t size);
+
+    /* Appends a printf-style formatted string to `sink` */
+    void (*append_fmt)(GeptSink *sink, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    /* Appends `size` bytes of `data` like @embed does, as rows of integers formatted
+     * according to `--embed-fmt` and `--embed-delim` */
+    void (*append_embed)(GeptSink *sink, const uint8_t *data, size_t size);
+
+    /* Appends `size` bytes of `data` as a C string literal (including the quotes),
+     * escaping as needed */
+    void (*append_c_string)(GeptSink *sink, const char *data, size_t size);
+
+    /* Computes the SHA-256 of `size` bytes of `data` */
+    void (*sha256)(const void *data, size_t size, uint8_t digest[32]);
+};
+
+/*--- Plugin entry point ----------------------------------------------------------------*/
+
+/* Called once when the plugin is loaded. Returns 0 on success */
+GEPT_PLUGIN_EXPORT int gept_plugin_init(const GeptApi *api);
+
+#endif /* GEPT_PLUGIN_H */
@@ -0,0 +1,506 @@
+
+/**
+ * LICENSE:
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Henrik A. Glass
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * MIT License
+ *
+ *
+ * ABOUT:
+ *
+ * hgl_hash.h implements a few common (non-cryptographic and cryptographic) hash
+ * functions: CRC32C, XXH64 and SHA-256.
+ *
+ *
+ * USAGE:
+ *
+ * Include hgl_hash.h file like this:
+ *
+ *     #define HGL_HASH_IMPLEMENTATION
+ *     #include "hgl_hash.h"
+ *
+ * HGL_HASH_IMPLEMENTATION must only be defined once, in a single compilation unit.
+ *
+ * On x86-64, CRC32C uses the SSE4.2 `crc32` instruction and SHA-256 uses the SHA
+ * extensions (SHA-NI) when the CPU supports them. Support is detected at runtime,
+ * so the same binary runs on CPUs without these extensions (using the portable
+ * implementations instead).
+ *
+ * Example:
+ *
+ *     uint8_t digest[32];
+ *     HglSha256 ctx;
+ *     hgl_hash_sha256_init(&ctx);
+ *     hgl_hash_sha256_update(&ctx, "hello ", 6);
+ *     hgl_hash_sha256_update(&ctx, "world", 5);
+ *     hgl_hash_sha256_final(&ctx, digest);
+ *
+ *     uint32_t crc = hgl_hash_crc32c("hello ", 6, 0);
+ *     crc = hgl_hash_crc32c("world", 5, crc); // same as hgl_hash_crc32c("hello world", 11, 0)
+ *
+ *
+ * AUTHOR: Henrik A. Glass
+ *
+ */
+
+#ifndef HGL_HASH_H
+#define HGL_HASH_H
+
+/*--- Include files ---------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*--- Public type definitions -----------------------------------------------------------*/
+
+typedef struct {
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t block_length;
+    uint64_t total_length;
+} HglSha256;
+
+/*--- Public function prototypes --------------------------------------------------------*/
+
+/**
+ * Computes the CRC32C (Castagnoli) of `size` bytes of `data`. `crc` is the CRC of
+ * any preceding data, or 0.
+ */
+uint32_t hgl_hash_crc32c(const void *data, size_t size, uint32_t crc);
+
+/**
+ * Computes the XXH64 hash of `size` bytes of `data` with seed `seed`.
+ */
+uint64_t hgl_hash_xxh64(const void *data, size_t size, uint64_t seed);
+
+/**
+ * Initializes a SHA-256 context.
+ */
+void hgl_hash_sha256_init(HglSha256 *ctx);
+
+/**
+ * Feeds `size` bytes of `data` into the SHA-256 context `ctx`.
+ */
+void hgl_hash_sha256_update(HglSha256 *ctx, const void *data, size_t size);
+
+/**
+ * Finalizes the SHA-256 context `ctx` and writes the digest to `digest`.
+ */
+void hgl_hash_sha256_final(HglSha256 *ctx, uint8_t digest[32]);
+
+/**
+ * Computes the SHA-256 digest of `size` bytes of `data`.
+ */
+void hgl_hash_sha256(const void *data, size_t size, uint8_t digest[32]);
+
+/**
+ * Writes the lowercase hexadecimal representation of `size` bytes of `data` to
+ * `hex`, which must have room for 2*`size` + 1 characters.
+ */
+void hgl_hash_to_hex(const uint8_t *data, size_t size, char *hex);
+
+#endif /* HGL_HASH_H */
+
+#ifdef HGL_HASH_IMPLEMENTATION
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HGL_HASH_X86_
+#endif
+
+/*--- CRC32C ----------------------------------------------------------------------------*/
+
+static uint32_t hgl_hash_crc32c_table_[8][256];
+static bool hgl_hash_crc32c_table_initialized_ = false;
+
+static uint32_t hgl_hash_crc32c_sw_(const uint8_t *p, size_t size, uint32_t crc)
+{
+    if (!hgl_hash_crc32c_table_initialized_) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+            }
+            hgl_hash_crc32c_table_[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) {
+                uint32_t prev = hgl_hash_crc32c_table_[t - 1][i];
+                hgl_hash_crc32c_table_[t][i] = (prev >> 8) ^ hgl_hash_crc32c_table_[0][prev & 0xFF];
+            }
+        }
+        hgl_hash_crc32c_table_initialized_ = true;
+    }
+
+    /* slicing-by-8 */
+    while (size >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= crc;
+        crc = hgl_hash_crc32c_table_[7][(v >>  0) & 0xFF] ^ hgl_hash_crc32c_table_[6][(v >>  8) & 0xFF] ^
+              hgl_hash_crc32c_table_[5][(v >> 16) & 0xFF] ^ hgl_hash_crc32c_table_[4][(v >> 24) & 0xFF] ^
+              hgl_hash_crc32c_table_[3][(v >> 32) & 0xFF] ^ hgl_hash_crc32c_table_[2][(v >> 40) & 0xFF] ^
+              hgl_hash_crc32c_table_[1][(v >> 48) & 0xFF] ^ hgl_hash_crc32c_table_[0][(v >> 56) & 0xFF];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ hgl_hash_crc32c_table_[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(HGL_HASH_X86_) && defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t hgl_hash_crc32c_hw_(const uint8_t *p, size_t size, uint32_t crc)
+{
+    uint64_t crc64 = crc;
+    while (size >= 32) {
+        uint64_t v[4];
+        memcpy(v, p, 32);
+        crc64 = _mm_crc32_u64(crc64, v[0]);
+        crc64 = _mm_crc32_u64(crc64, v[1]);
+        crc64 = _mm_crc32_u64(crc64, v[2]);
+        crc64 = _mm_crc32_u64(crc64, v[3]);
+        p += 32;
+        size -= 32;
+    }
+    while (size >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+        p += 8;
+        size -= 8;
+    }
+    crc = (uint32_t) crc64;
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t hgl_hash_crc32c(const void *data, size_t size, uint32_t crc)
+{
+    crc = ~crc;
+#if defined(HGL_HASH_X86_) && defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~hgl_hash_crc32c_hw_((const uint8_t *) data, size, crc);
+    }
+#endif
+    return ~hgl_hash_crc32c_sw_((const uint8_t *) data, size, crc);
+}
+
+/*--- XXH64 -----------------------------------------------------------------------------*/
+
+#define HGL_XXH_P1_ 0x9E3779B185EBCA87ULL
+#define HGL_XXH_P2_ 0xC2B2AE3D27D4EB4FULL
+#define HGL_XXH_P3_ 0x165667B19E3779F9ULL
+#define HGL_XXH_P4_ 0x85EBCA77C2B2AE63ULL
+#define HGL_XXH_P5_ 0x27D4EB2F165667C5ULL
+
+static inline uint64_t hgl_hash_rotl64_(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hgl_hash_xxh64_round_(uint64_t acc, uint64_t input)
+{
+    acc += input * HGL_XXH_P2_;
+    acc  = hgl_hash_rotl64_(acc, 31);
+    return acc * HGL_XXH_P1_;
+}
+
+static inline uint64_t hgl_hash_xxh64_merge_(uint64_t acc, uint64_t v)
+{
+    acc ^= hgl_hash_xxh64_round_(0, v);
+    return acc * HGL_XXH_P1_ + HGL_XXH_P4_;
+}
+
+uint64_t hgl_hash_xxh64(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p   = (const uint8_t *) data;
+    const uint8_t *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + HGL_XXH_P1_ + HGL_XXH_P2_;
+        uint64_t v2 = seed + HGL_XXH_P2_;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HGL_XXH_P1_;
+        do {
+            uint64_t lanes[4];
+            memcpy(lanes, p, 32);
+            v1 = hgl_hash_xxh64_round_(v1, lanes[0]);
+            v2 = hgl_hash_xxh64_round_(v2, lanes[1]);
+            v3 = hgl_hash_xxh64_round_(v3, lanes[2]);
+            v4 = hgl_hash_xxh64_round_(v4, lanes[3]);
+            p += 32;
+        } while (end - p >= 32);
+
+        h = hgl_hash_rotl64_(v1, 1) + hgl_hash_rotl64_(v2, 7) +
+            hgl_hash_rotl64_(v3, 12) + hgl_hash_rotl64_(v4, 18);
+        h = hgl_hash_xxh64_merge_(h, v1);
+        h = hgl_hash_xxh64_merge_(h, v2);
+        h = hgl_hash_xxh64_merge_(h, v3);
+        h = hgl_hash_xxh64_merge_(h, v4);
+    } else {
+        h = seed + HGL_XXH_P5_;
+    }
+
+    h += (uint64_t) size;
+
+    while (end - p >= 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h ^= hgl_hash_xxh64_round_(0, k);
+        h  = hgl_hash_rotl64_(h, 27) * HGL_XXH_P1_ + HGL_XXH_P4_;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        uint32_t k;
+        memcpy(&k, p, 4);
+        h ^= (uint64_t) k * HGL_XXH_P1_;
+        h  = hgl_hash_rotl64_(h, 23) * HGL_XXH_P2_ + HGL_XXH_P3_;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (uint64_t) (*p++) * HGL_XXH_P5_;
+        h  = hgl_hash_rotl64_(h, 11) * HGL_XXH_P1_;
+    }
+
+    h ^= h >> 33;
+    h *= HGL_XXH_P2_;
+    h ^= h >> 29;
+    h *= HGL_XXH_P3_;
+    h ^= h >> 32;
+    return h;
+}
+
+/*--- SHA-256 ---------------------------------------------------------------------------*/
+
+static const uint32_t hgl_hash_sha256_k_[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static inline uint32_t hgl_hash_rotr32_(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static void hgl_hash_sha256_blocks_sw_(uint32_t state[8], const uint8_t *p, size_t n_blocks)
+{
+    while (n_blocks-- > 0) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = ((uint32_t) p[4*i] << 24) | ((uint32_t) p[4*i + 1] << 16) |
+                   ((uint32_t) p[4*i + 2] << 8) | (uint32_t) p[4*i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = hgl_hash_rotr32_(w[i-15], 7) ^ hgl_hash_rotr32_(w[i-15], 18) ^ (w[i-15] >> 3);
+            uint32_t s1 = hgl_hash_rotr32_(w[i-2], 17) ^ hgl_hash_rotr32_(w[i-2], 19) ^ (w[i-2] >> 10);
+            w[i] = w[i-16] + s0 + w[i-7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t S1 = hgl_hash_rotr32_(e, 6) ^ hgl_hash_rotr32_(e, 11) ^ hgl_hash_rotr32_(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + S1 + ch + hgl_hash_sha256_k_[i] + w[i];
+            uint32_t S0 = hgl_hash_rotr32_(a, 2) ^ hgl_hash_rotr32_(a, 13) ^ hgl_hash_rotr32_(a, 22);
+            uint32_t mj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = S0 + mj;
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        p += 64;
+    }
+}
+
+#if defined(HGL_HASH_X86_)
+__attribute__((target("sha,sse4.1")))
+static void hgl_hash_sha256_blocks_hw_(uint32_t state[8], const uint8_t *p, size_t n_blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+    /* state is kept as {A,B,E,F} and {C,D,G,H} */
+    __m128i tmp    = _mm_loadu_si128((const __m128i *) &state[0]);
+    __m128i state1 = _mm_loadu_si128((const __m128i *) &state[4]);
+    tmp    = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    while (n_blocks-- > 0) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i w[4];
+
+        /* 16 groups of 4 rounds. The message schedule is computed on the fly */
+#pragma GCC unroll 16
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 16*g)), MASK);
+            }
+            __m128i msg = _mm_add_epi32(w[g & 3], _mm_loadu_si128((const __m128i *) &hgl_hash_sha256_k_[4*g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (g >= 3 && g <= 14) {
+                tmp = _mm_alignr_epi8(w[g & 3], w[(g - 1) & 3], 4);
+                w[(g + 1) & 3] = _mm_add_epi32(w[(g + 1) & 3], tmp);
+                w[(g + 1) & 3] = _mm_sha256msg2_epu32(w[(g + 1) & 3], w[g & 3]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (g >= 1 && g <= 12) {
+                w[(g - 1) & 3] = _mm_sha256msg1_epu32(w[(g - 1) & 3], w[g & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        p += 64;
+    }
+
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *) &state[0], state0);
+    _mm_storeu_si128((__m128i *) &state[4], state1);
+}
+
+static bool hgl_hash_has_sha_ni_(void)
+{
+    static int has_sha_ni = -1;
+    if (has_sha_ni == -1) {
+        unsigned int eax, ebx, ecx, edx;
+        has_sha_ni = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+                     (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1");
+    }
+    return has_sha_ni;
+}
+#endif
+
+static void hgl_hash_sha256_blocks_(uint32_t state[8], const uint8_t *p, size_t n_blocks)
+{
+#if defined(HGL_HASH_X86_)
+    if (hgl_hash_has_sha_ni_()) {
+        hgl_hash_sha256_blocks_hw_(state, p, n_blocks);
+        return;
+    }
+#endif
+    hgl_hash_sha256_blocks_sw_(state, p, n_blocks);
+}
+
+void hgl_hash_sha256_init(HglSha256 *ctx)
+{
+    static const uint32_t iv[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->block_length = 0;
+    ctx->total_length = 0;
+}
+
+void hgl_hash_sha256_update(HglSha256 *ctx, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    ctx->total_length += size;
+
+    /* fill up partial block */
+    if (ctx->block_length > 0) {
+        size_t n = 64 - ctx->block_length;
+        n = (size < n) ? size : n;
+        memcpy(ctx->block + ctx->block_length, p, n);
+        ctx->block_length += n;
+        p    += n;
+        size -= n;
+        if (ctx->block_length < 64) {
+            return;
+        }
+        hgl_hash_sha256_blocks_(ctx->state, ctx->block, 1);
+        ctx->block_length = 0;
+    }
+
+    /* full blocks directly from `data` */
+    if (size >= 64) {
+        hgl_hash_sha256_blocks_(ctx->state, p, size / 64);
+        p    += size & ~(size_t) 63;
+        size &= 63;
+    }
+
+    memcpy(ctx->block, p, size);
+    ctx->block_length = size;
+}
+
+void hgl_hash_sha256_final(HglSha256 *ctx, uint8_t digest[32])
+{
+    uint64_t bit_length = ctx->total_length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_length = (ctx->block_length < 56) ? 56 - ctx->block_length : 120 - ctx->block_length;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_length + i] = (uint8_t) (bit_length >> (56 - 8*i));
+    }
+    hgl_hash_sha256_update(ctx, pad, pad_length + 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4*i + 0] = (uint8_t) (ctx->state[i] >> 24);
+        digest[4*i + 1] = (uint8_t) (ctx->state[i] >> 16);
+        digest[4*i + 2] = (uint8_t) (ctx->state[i] >> 8);
+        digest[4*i + 3] = (uint8_t) (ctx->state[i]);
+    }
+}
+
+void hgl_hash_sha256(const void *data, size_t size, uint8_t digest[32])
+{
+    HglSha256 ctx;
+    hgl_hash_sha256_init(&ctx);
+    hgl_hash_sha256_update(&ctx, data, size);
+    hgl_hash_sha256_final(&ctx, digest);
+}
+
+void hgl_hash_to_hex(const uint8_t *data, size_t size, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; i++) {
+        hex[2*i]     = digits[data[i] >> 4];
+        hex[2*i + 1] = digits[data[i] & 0xF];
+    }
+    hex[2*size] = '\0';
+}
+
+#endif
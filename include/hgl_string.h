@@ -45,6 +45,16 @@
  * null-terminated string type (although the "immutable" part should be taking with a
  * grain of salt - this is still C).
  *
+ * HglSlice is a lean (16 byte) variant of HglStringView for hot loops. It has no iterator
+ * field, so it is passed and returned in registers, and its operations are static inline
+ * functions defined in the header. Iteration state lives in a separate HglSliceCursor:
+ *
+ *     HglSliceCursor cursor = hgl_slice_cursor(hgl_slice_from_sv(sv));
+ *     HglSlice line;
+ *     while (hgl_slice_cursor_next(&cursor, '\n', &line)) {
+ *         ...
+ *     }
+ *
  * hgl_string.h allows the default allocator, reallocator and free function to be
  * overridden by redefining the following defines before including hgl_string.h:
  *
@@ -163,6 +173,18 @@ typedef struct {
     size_t it_;          /* gen. purpose iterator for reentrant string view ops. */
 } HglStringView;
 
+/* lean immutable string type for hot paths. Does not own the underlying `ptr`. */
+typedef struct {
+    const char *ptr;     /* optionally null-terminated string */
+    size_t len;          /* length of slice, excluding null terminator */
+} HglSlice;
+
+/* iteration state over a slice, kept out of the slice itself. */
+typedef struct {
+    HglSlice s;          /* slice being iterated */
+    size_t pos;          /* offset of the next element in `s` */
+} HglSliceCursor;
+
 /*=======================================================================================*/
 /*--- String View function prototypes ---------------------------------------------------*/
 /*=======================================================================================*/
@@ -388,6 +410,114 @@ bool hgl_sv_equals(HglStringView a, HglStringView b);
  */
 bool hgl_sv_equals_cstr(HglStringView sv, const char *cstr);
 
+/*=======================================================================================*/
+/*--- Slice functions (header-only) -----------------------------------------------------*/
+/*=======================================================================================*/
+
+/**
+ * Create a slice of `ptr` with length `len`
+ */
+static inline HglSlice hgl_slice_from(const char *ptr, size_t len)
+{
+    return (HglSlice) {.ptr = ptr, .len = len};
+}
+
+/**
+ * Create a slice of the string view `sv`
+ */
+static inline HglSlice hgl_slice_from_sv(HglStringView sv)
+{
+    return (HglSlice) {.ptr = sv.start, .len = sv.length};
+}
+
+/**
+ * Create a string view of the slice `s`
+ */
+static inline HglStringView hgl_slice_to_sv(HglSlice s)
+{
+    return (HglStringView) {.start = s.ptr, .length = s.len, .it_ = 0};
+}
+
+/**
+ * Returns a slice of `s` of length `n`, starting at `offset`. Both are clamped to
+ * the end of `s`.
+ */
+static inline HglSlice hgl_slice_substr(HglSlice s, size_t offset, size_t n)
+{
+    offset = (offset > s.len) ? s.len : offset;
+    n      = (n > s.len - offset) ? s.len - offset : n;
+    return (HglSlice) {.ptr = s.ptr + offset, .len = n};
+}
+
+/**
+ * Chops `s` up to the first occurrence of `delim` and returns the part before it.
+ * The delimiter is consumed. If `delim` isn't found, all of `s` is returned and `s`
+ * is left empty (pointing at its end).
+ */
+static inline HglSlice hgl_slice_lchop_until(HglSlice *s, char delim)
+{
+    const char *hit = (s->len == 0) ? NULL : (const char *) memchr(s->ptr, delim, s->len);
+    size_t n = (hit == NULL) ? s->len : (size_t) (hit - s->ptr);
+    HglSlice left_part = {.ptr = s->ptr, .len = n};
+    size_t consumed = (hit == NULL) ? n : n + 1;
+    s->ptr += consumed;
+    s->len -= consumed;
+    return left_part;
+}
+
+/**
+ * Returns `s` without leading whitespace
+ */
+static inline HglSlice hgl_slice_ltrim(HglSlice s)
+{
+    while (s.len > 0 && isspace((unsigned char) *s.ptr)) {
+        s.ptr++;
+        s.len--;
+    }
+    return s;
+}
+
+/**
+ * Returns true if `s` starts with the character `c`
+ */
+static inline bool hgl_slice_starts_with_char(HglSlice s, char c)
+{
+    return s.len > 0 && s.ptr[0] == c;
+}
+
+/**
+ * Returns true if `a` and `b` are equal
+ */
+static inline bool hgl_slice_equals(HglSlice a, HglSlice b)
+{
+    return a.len == b.len && (a.len == 0 || memcmp(a.ptr, b.ptr, a.len) == 0);
+}
+
+/**
+ * Create a cursor at the start of `s`
+ */
+static inline HglSliceCursor hgl_slice_cursor(HglSlice s)
+{
+    return (HglSliceCursor) {.s = s, .pos = 0};
+}
+
+/**
+ * Stores the part of the cursor's slice up to the next `delim` in `out` and moves
+ * the cursor past the delimiter. Returns false once the slice is exhausted. A
+ * trailing delimiter doesn't produce an empty last element.
+ */
+static inline bool hgl_slice_cursor_next(HglSliceCursor *cursor, char delim, HglSlice *out)
+{
+    if (cursor->pos >= cursor->s.len) {
+        return false;
+    }
+    HglSlice rest = {.ptr = cursor->s.ptr + cursor->pos, .len = cursor->s.len - cursor->pos};
+    size_t before = rest.len;
+    *out = hgl_slice_lchop_until(&rest, delim);
+    cursor->pos += before - rest.len;
+    return true;
+}
+
 /*=======================================================================================*/
 /*--- String Builder function prototypes ------------------------------------------------*/
 /*=======================================================================================*/
@@ -39,7 +39,7 @@
  *
  * or simply:
  *
- *     $ gcc -Iinclude src/gept.c -o gept
+ *     $ gcc -Iinclude src/gept.c -o gept -lm -ldl
  *
  *
  * USAGE:
@@ -62,7 +62,8 @@
  *
  * The following directives are supported:
  *
- *     * @embed <file> [limit(N)] - the `@embed` directive is a single line-directive which
+ *     * @embed <file> [limit(N)] [extern(NAME)] [source(PATH)] [shared(NAME)] [decompress(gzip)]
+ *                                - the `@embed` directive is a single line-directive which
  *                                  takes the path of a file as its argument and, upon
  *                                  expansion, embeds it as a comma-separated (default) list of
  *                                  byte-sized integers. Optionally, the `limit(N)` attribute
@@ -73,12 +74,101 @@
  *                                  read semantics. The default @embed byte format and delimiter
  *                                  may be changed using the `--embed-fmt` and `--embed-delim`
  *                                  command-line options.
- *     * @include <file>          - the `@include` directive is a single line-directive which
+ *                                  With `extern(NAME)`, the directive instead expands to the
+ *                                  declarations `extern const unsigned char NAME[N];` and
+ *                                  `extern const size_t NAME_len;` (so <stddef.h> must be included),
+ *                                  and the definitions are written to the companion source file
+ *                                  given by `source(PATH)` or the `--embed-source` option. Large
+ *                                  blobs are then compiled once instead of once per includer.
+ *                                  With `shared(NAME)`, the data is defined in every translation
+ *                                  unit instead, as a weak symbol named after a hash of its contents
+ *                                  (a COMDAT group on ELF, `selectany` with MSVC), and `NAME` and
+ *                                  `NAME_len` are macros referring to it. Identical blobs embedded
+ *                                  by different templates are then merged by the linker.
+ *                                  With `decompress(gzip)`, <file> is a gzip file, which is
+ *                                  decompressed by a built-in decoder, chunk by chunk, straight
+ *                                  into the encoder. `limit(N)` applies to the decompressed data.
+ *     * @random bytes(N) [seed(S)] [dist(D)]
+ *                                - the `@random` directive is a single line-directive which
+ *                                  embeds N pseudo-random bytes generated from the seed S
+ *                                  (default 0), like `@embed` does (including `extern(NAME)` and
+ *                                  `source(PATH)`). The bytes only depend on S, so the output is
+ *                                  reproducible, and they are generated by four interleaved
+ *                                  xoshiro256** generators at several GB/s. `dist(D)` selects the
+ *                                  distribution: `uniform` (default), `range, LO, HI` (uniform in
+ *                                  [LO, HI]), `ascii` (printable characters) or `normal, MEAN, STDDEV`
+ *                                  (rounded and clamped to [0, 255]).
+ *     * @lines <file> [count(MACRO)]
+ *                                - the `@lines` directive is a single line-directive which
+ *                                  expands to the lines of <file> (without line terminators) as
+ *                                  C string literals, one per row and separated by commas, for use
+ *                                  in a `const char *[]` initializer. Quotes, backslashes, control
+ *                                  characters and trigraphs are escaped. With `count(MACRO)`, the
+ *                                  rows are preceded by `#define MACRO <number of lines>`.
+ *     * @include <file> [lines(A,B)] [section(BEGIN,END)] [filters...] [decompress(gzip)]
+ *                                - the `@include` directive is a single line-directive which
  *                                  works the same as the C preprocessor `#include` directive;
- *                                  it will simply output the contents of <file>.
+ *                                  it will simply output the contents of <file>. Optionally,
+ *                                  either the `lines(A,B)` or the `section(BEGIN,END)` attribute
+ *                                  may be specified. `lines(A,B)` only includes lines A through
+ *                                  B (counted from 1, inclusive. B may be `$` for the last line).
+ *                                  `section(BEGIN,END)` only includes the lines between the line
+ *                                  containing the marker BEGIN and the next line containing the
+ *                                  marker END (exclusive). Markers may be quoted, e.g.
+ *                                  section("// BEGIN TABLE", "// END TABLE").
+ *                                  The contents may further be passed through a chain of
+ *                                  filters, applied line by line in the order they are given:
+ *                                  `filter(REGEX)` keeps only lines matching REGEX, `exclude(REGEX)`
+ *                                  drops lines matching REGEX, `replace(REGEX, REPLACEMENT)` replaces
+ *                                  all matches of REGEX (`\1`..`\9` refer to subexpressions), and
+ *                                  `strip-comments(c|sh)` removes C-style or shell-style comments
+ *                                  (which, like in sh, start with a `#` at the start of a word).
+ *                                  Regexes are POSIX extended regular expressions.
+ *                                  With `decompress(gzip)`, <file> is a gzip file, which is
+ *                                  decompressed by the built-in decoder of @embed. All other
+ *                                  attributes apply to the decompressed contents.
+ *     * @csv <file> [delim(C)] [header(none)] ... @end
+ *     * @json <file> ... @end
+ *                                - the `@csv` and `@json` directives are multi-line directives
+ *                                  which instantiate the body (the "row template") once for
+ *                                  every record in <file>. Fields are referred to in the row
+ *                                  template as `{column}` or `{column:type}`, where `column` is
+ *                                  a CSV header name or JSON object key (or an index, for CSV
+ *                                  files without a header and JSON arrays of arrays). Values are
+ *                                  validated against `type` which is one of `raw` (default, copied
+ *                                  verbatim), `str` (C string literal), `i8`-`i64`/`int`, `u8`-`u64`/
+ *                                  `uint`, `x8`-`x64`/`hex` (printed in hex), `f32`/`float`,
+ *                                  `f64`/`double` or `bool`. `{{` is a literal `{`. For CSV files,
+ *                                  `delim(C)` sets the field delimiter (default `,`) and `header(none)`
+ *                                  indicates that the first row is not a header. JSON files must
+ *                                  be valid JSON holding an array of objects or arrays.
+ *     * @lut <generator> [...]   - the `@lut` directive is a single-line directive which
+ *                                  generates a lookup table natively and expands to a
+ *                                  comma-separated list of its values. Supported generators are
+ *                                  `crc8`, `crc16`, `crc32`, `crc32c` and `crc` (256-entry CRC
+ *                                  tables, parameterized by `poly(P)`, `reflect(0|1)` and, for
+ *                                  `crc`, `width(N)`. P is always in normal, MSB-first form, e.g.
+ *                                  0x04C11DB7 for CRC-32, and is bit-reversed for reflected
+ *                                  tables), `sin` and `cos` (one full period of
+ *                                  `size(N)` entries in signed fixed-point format `q(I.F)`,
+ *                                  default q(1.15)), `gamma` (`size(N)` entries of x^`gamma(G)`
+ *                                  scaled to `width(N)` bits), `popcount` (`size(N)` entries)
+ *                                  and `bitrev` (2^`width(N)` entries).
+ *     * @hash <file> [algo(A)] [fmt(F)]
+ *                                - the `@hash` directive is a single-line directive which
+ *                                  expands to the hash of <file>. `algo(A)` selects the hash
+ *                                  function: `crc32c`, `xxh64` or `sha256` (default). `fmt(F)`
+ *                                  selects the output format: bare lowercase hex (`hex`, default),
+ *                                  a C string literal (`str`) or an integer literal (`int`, not
+ *                                  available for sha256). CRC32C and SHA-256 use the SSE4.2 and
+ *                                  SHA extensions respectively, where available.
  *     * @sizeof <file>           - the `@sizeof` directive is a single line-directive which
  *                                  takes the path of a file as its argument and expands to
  *                                  the size of the file.
+ *     * @mtime, @mode, @inode    - like `@sizeof`, but expand to the modification time of
+ *       <file>                     <file> (seconds since the epoch), its permission bits (in
+ *                                  octal) and its inode number respectively. Files are never
+ *                                  opened, and every path is stat'ed once per run.
  *     * @bash ... @end           - the `@bash` directive is a multi-line directive, which
  *                                  takes a bash script and expands to the output of said
  *                                  bash script.
@@ -88,6 +178,16 @@
  *     * @perl ... @end           - the `@perl` directive is a multi-line directive, which
  *                                  takes a perl-script and expands to the output of said
  *                                  perl script.
+ *     * @output <file> ... @end
+ *                                - the `@output` directive is a multi-line directive which
+ *                                  routes everything between it and its `@end` (after expansion)
+ *                                  to the file at <file> instead of stdout. Directives inside the
+ *                                  block are expanded as usual, and `@output` blocks may be nested.
+ *                                  Blocks with the same <file> are concatenated in template order.
+ *                                  Output files are written once the whole template has been
+ *                                  expanded, and files whose contents are unchanged are not
+ *                                  rewritten. This lets one template pass (running each script
+ *                                  block once) generate several files.
  *
  * By default, GEPT uses firejail to run subprocesses in a semi-sandboxed environment where
  * they can't make any changes to the file system (with a few exceptions, such as /tmp). This
@@ -95,6 +195,110 @@
  * other than writing to stdout and to avoid possible footguns. Sandboxing can be disabled by 
  * running gept with the `--yolo` option which enables "YOLO-mode".
  *
+ * Script blocks run in the background while the rest of the template is expanded, and their
+ * output is spliced in once they are done. By default only one script runs at a time. The
+ * `-j,--jobs N` option allows up to N scripts to run in parallel. When run from a recursive
+ * make recipe (e.g. `+gept ...`), GEPT acts as a GNU make jobserver client (both the pipe and
+ * the fifo styles) and takes a token for every script beyond the first. The build as a whole
+ * then stays within make's `-jN`. Scripts running in parallel must not depend on each other's
+ * side effects. With more than one job, scripts start in the background as soon as a slot is
+ * free, while the rest of the template is expanded. Scripts waiting for a slot start the
+ * longest expected first, so a slow script doesn't end up on the critical path. `--history DIR`
+ * keeps a small file per template in DIR with the duration of each of its script blocks (keyed
+ * by a hash of the block), updated by every run. Once the history of a template knows several
+ * of its blocks, its scripts are held back until the template has been expanded, so all of
+ * them are started in that order. Blocks without a history are expected to take as long as the
+ * scripts of their interpreter in this run, on average (50 ms before any has finished).
+ *
+ * Instead of a single template, `--batch FILE` expands every template listed in FILE, one
+ * `<template> <output>` pair per line, and writes each expansion to its output file. Script
+ * blocks of all templates share the `-j,--jobs` limit. With `--shard I/N`, the templates are
+ * split into N shards of roughly equal cost and only shard I (0 <= I < N) is expanded. N
+ * machines or processes sharing a checkout can then split the work between them. The cost of
+ * a template is estimated from its size and the number of script blocks in it, or taken from
+ * the timing report of a previous run given with `--timings`. Every shard computes the same
+ * partition, as long as all shards see the same batch file, templates and timing report.
+ * `--timings-out FILE` merges the measured timings of this run into FILE, which concurrent
+ * shards can share. The merged report then serves as `--timings` for the next run.
+ *
+ * `--variants FILE` generates several configurations of a template in one run. Every line of
+ * FILE holds the output file of a variant followed by its `NAME=VALUE` defines, e.g.
+ * `out/arm.h ARCH=arm BITS=32`, which scripts see in their environment. The template is
+ * parsed and expanded once, so files are read, embedded and hashed once for all variants.
+ * Scripts run once per variant, in parallel up to the `-j,--jobs` limit. Variants a script
+ * has the same cache key for, i.e. which have the same defines, share one run. Scripts
+ * marked `shared` (`@bash shared`) run once, with only the defines which are the same in
+ * every variant, and their output goes into every variant; a warning is printed if they
+ * mention a define which differs between variants. Scripts inside @output blocks must be
+ * marked `shared`.
+ *
+ * With `--cache-dir DIR`, the output of every script block is cached in DIR, keyed by a
+ * SHA-256 of the script, its interpreter and its sandbox settings. Cached scripts are not run
+ * again. `--remote-cache http://host[:port][/prefix]` adds a shared HTTP cache behind the local
+ * one, which is read with GET and written with PUT. Entries are laid out like a Bazel HTTP
+ * remote cache: `/ac/<key>` holds the SHA-256 of the output and `/cas/<sha256>` holds the
+ * output itself. (bazel-remote needs `--disable_http_ac_validation`.) A failing remote cache
+ * only produces a warning. Every remote request, from connecting to the last byte of the
+ * reply, times out after `--remote-cache-timeout` milliseconds. The host is resolved once,
+ * at startup. `examples/test_remote_cache.sh` checks this against a stand-in server.
+ * Caching assumes that the output of a script depends only on its source. Unless
+ * `--trace-inputs` is given, don't use a cache with scripts which read files, the clock or
+ * random numbers.
+ *
+ * With `--trace-inputs`, GEPT records every file a script opens, executes or stats (the script
+ * and every process it starts), using seccomp user notifications. Cache entries then start
+ * with a manifest of these inputs and the SHA-256 of their contents, or just their type for
+ * files which were only stat'ed, and a cached output is only reused while every input is
+ * unchanged. Files which didn't exist are recorded as well, so creating them invalidates the
+ * entry. Caching is then sound for scripts which read files, but not for scripts which read
+ * the clock, random numbers or the network. Files below /usr, /bin, /lib, /proc, /sys and
+ * /dev are assumed not to change. Tracing needs Linux 5.5 and `--yolo`, since traced scripts
+ * run with no_new_privs, which keeps firejail from sandboxing them. `--depfile out.c.d`
+ * writes a make-style depfile, in which every output file depends on the template(s), the
+ * files read by directives and, with `--trace-inputs`, the files read by scripts. Output
+ * written to stdout is named after the depfile, i.e. `out.c` above.
+ *
+ * New directives can be added with plugins: shared objects which are loaded with
+ * `--plugin a.so,b.so` and expanded in-process, without forking or starting an interpreter.
+ * The plugin ABI is defined and documented in `include/gept_plugin.h`. Plugins get access to
+ * GEPT's argument parser, its mapped file cache and the @embed and C string encoders. See
+ * `examples/example_plugin.c`, which is built with `make example-plugin`.
+ *
+ * With `--expand-depth N`, directives in the output of a script block are expanded as well,
+ * in memory: a script may generate @embed, @include or further script blocks. Scripts
+ * generated that way are expanded up to N levels deep, and their output is left as is beyond
+ * that. A script generating the same output as a script it was generated by is reported as
+ * an expansion cycle. Cached output is expanded like the output of the script itself.
+ *
+ * `--plan` reports what expanding the template (or the batch shard) would do, without
+ * running any script or writing any output: for every directive, the bytes it reads and an
+ * estimate of the bytes it outputs, followed by the number of scripts per interpreter,
+ * whether their output is cached (with `--cache-dir` or `--remote-cache`), the total output
+ * buffered in memory (and in the companion sources of extern arrays) and an estimated
+ * runtime, taken from `--timings` where available.
+ *
+ * Templates which are expanded over and over can be compiled: `--compile gen.c` writes a
+ * standalone C program which writes the expansion of the template, including its @output
+ * files. Everything but script blocks is expanded at compile time and becomes static data,
+ * so running the program costs little more than writing its output. Script blocks are run
+ * by the program, with every `NAME=VALUE` argument of the program in their environment, so
+ * they are never served from the script cache: `./gept --compile gen.c -i tpl && cc gen.c -o gen && ./gen MODE=fast`.
+ *
+ * `--cc -- gcc -c -x c - -o out.o` streams the expansion into the stdin of the compiler
+ * command following `--`, instead of printing it, so no temporary file is written. Output is
+ * written as soon as it is final, i.e. up to the first script that is still running, so the
+ * compiler starts parsing while the rest of the template is expanded. GEPT exits with the
+ * exit status of the first compiler which failed. With `--batch`, every template gets its own
+ * compiler, with `{}` in the command replaced by its output path (`-o {}`), and up to
+ * `-j,--jobs` compilers run in parallel. @output files are written as usual.
+ *
+ * Script directives are looked up in a registry of interpreters, which maps a directive to
+ * the command line its scripts are written to. Besides @bash, @python and @perl, any
+ * interpreter which reads a script from stdin can be added, and the defaults replaced with
+ * faster-starting profiles: `--interp 'node=node -;python=python3 -S -E'` or `--interp @FILE`
+ * with one `name = command line` entry per line. `--stats` prints how many scripts every
+ * interpreter ran, how long they took to produce their first output and how long they ran.
+ *
  * You can get a list of all supportet GEPT options by running `./gept --help`:
  *
  *     GEPT - [GE]neric [P]rogrammable [T]emplates
@@ -107,6 +311,26 @@
  *       --bash-path              Alternative path to the bash executable (default = -)
  *       --embed-fmt              C-style format string used by the @embed directive. (default = "0x%02X")
  *       --embed-delim            Delimiter string used by the @embed directive (default = ", ")
+ *       --embed-source           Companion source file for `@embed <file> extern(NAME)` definitions (default = -)
+ *       -j,--jobs                Maximum number of scripts run in parallel. Defaults to 1, or to what the make jobserver allows when run by make (default = 0, valid range = [0, 1024])
+ *       --batch                  Expand every `<template> <output>` pair listed in the given file (default = -)
+ *       --variants               Write an output for every `<output> [NAME=VALUE]...` variant listed in the given file, expanding the template once (default = -)
+ *       --shard                  Only expand shard I/N (0 <= I < N) of the batch, balanced by estimated cost (default = -)
+ *       --timings                Timing report of a previous run, used to balance the shards (default = -)
+ *       --timings-out            Timing report the timings of this run are merged into (default = -)
+ *       --history                Directory of per-template script durations, used to start the longest scripts first (default = -)
+ *       --plugin                 Comma-separated list of plugins (shared objects) to load (default = -)
+ *       --cache-dir              Directory in which script outputs are cached (default = -)
+ *       --remote-cache           URL (http://host[:port][/prefix]) of a shared HTTP cache for script outputs (default = -)
+ *       --remote-cache-timeout   Timeout of remote cache operations in milliseconds (default = 2000, valid range = [1, 600000])
+ *       --expand-depth           Expand directives in script output, up to this many levels deep (0 = off) (default = 0, valid range = [0, 64])
+ *       --compile                Write a standalone C program to the given path, which writes the expansion of the template (default = -)
+ *       --cc                     Stream the expansion into the stdin of the compiler command following `--`, e.g. `--cc -- gcc -c -x c - -o out.o`. With --batch, `{}` in the command is replaced by the output path (default = 0)
+ *       --interp                 Script interpreters: `name=command line` entries separated by `;`, or `@FILE` with one per line (default = -)
+ *       --stats                  Print how many scripts every interpreter ran and how long they took to stderr (default = 0)
+ *       --trace-inputs           Record the files every script reads, and only reuse cached output while they are unchanged (needs --yolo) (default = 0)
+ *       --depfile                Write a make-style depfile, listing the files the expansion read, to the given path (default = -)
+ *       --plan                   Report what expanding the template(s) would read, run and output, without doing it (default = 0)
  *       -yolo, --yolo            Enable YOLO-mode. Run @python, @perl, and @bash in a non-sandboxed environment. (default = 0)
  *       -h,--help                Displays this help message (default = 0)
  * 
@@ -120,7 +344,7 @@
  *
  */
 
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 
 #define HGL_FLAGS_IMPLEMENTATION
 #include "hgl_flags.h"
@@ -128,13 +352,54 @@
 #define HGL_STRING_IMPLEMENTATION
 #include "hgl_string.h"
 
+#define HGL_HASH_IMPLEMENTATION
+#include "hgl_hash.h"
+
+#include "gept_plugin.h"
+
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
+#include <float.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <stddef.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/seccomp.h>)
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* architecture of the syscall numbers traced by `--trace-inputs`. Unsupported elsewhere */
+#if defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && defined(__x86_64__)
+#define TRACE_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && defined(__aarch64__)
+#define TRACE_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#endif
 
 #define GEPT_ASSERT(arg, ...)                     \
     if (!(arg)) {                                 \
@@ -150,6 +415,260 @@
     }
 
 #define SCRATCH_BUFFER_SIZE (128*1024*1024)
+#define MAX_ATTRIBUTE_ARGS 4
+#define MAX_FILTERS 16
+#define MAX_ROW_FIELDS 256
+#define MAX_JSON_DEPTH 256
+#define MAX_OUTPUT_DEPTH 16
+#define MAX_VARIANT_DEFINES 256
+#define INFLATE_WINDOW_SIZE 32768        /* farthest a deflate match may refer back */
+#define INFLATE_CHUNK_SIZE (20 * 16384)  /* a whole number of @embed rows */
+#define INFLATE_FAST_BITS 10
+
+typedef struct {
+    HglStringView name;                     /* e.g. `limit` in `limit(10)` */
+    HglStringView args[MAX_ATTRIBUTE_ARGS]; /* comma-separated arguments, quotes stripped */
+    int n_args;
+} Attribute;
+
+typedef struct {
+    char *path;           /* NULL-terminated copy of the path used to open the file */
+    char *data;           /* file contents. mmap'd for regular files, malloc'd otherwise */
+    size_t size;          /* size of `data` in bytes */
+    bool is_mapped;
+    size_t *line_offsets; /* lazily built index of line start offsets */
+    size_t n_lines;
+} MappedFile;
+
+typedef struct {
+    char *path;
+    uint64_t size;
+    int64_t mtime;        /* seconds since the epoch */
+    uint32_t mode;        /* permission bits, as in `st_mode & 07777` */
+    uint64_t inode;
+} FileStat;
+
+typedef enum {
+    FILTER_MATCH,          /* filter(regex)        - keep only lines matching regex */
+    FILTER_EXCLUDE,        /* exclude(regex)       - drop lines matching regex */
+    FILTER_REPLACE,        /* replace(regex, repl) - replace all matches with repl */
+    FILTER_STRIP_COMMENTS, /* strip-comments(lang) - remove comments of language lang */
+} FilterKind;
+
+typedef enum {
+    COMMENT_STYLE_C,  /* C/C++ line and block comments */
+    COMMENT_STYLE_SH, /* shell/python/perl-style `#` comments */
+} CommentStyle;
+
+typedef struct {
+    FilterKind kind;
+    regex_t *re;
+    HglStringView replacement;
+    CommentStyle comment_style;
+} Filter;
+
+typedef struct {
+    char *pattern;
+    regex_t re;
+} CompiledRegex;
+
+typedef enum {
+    FIELD_RAW,    /* verbatim */
+    FIELD_STR,    /* C string literal */
+    FIELD_INT,    /* signed integer, range checked */
+    FIELD_UINT,   /* unsigned integer, range checked */
+    FIELD_HEX,    /* unsigned integer, range checked, printed in hex */
+    FIELD_FLOAT,  /* float literal */
+    FIELD_DOUBLE, /* double literal */
+    FIELD_BOOL,   /* true or false */
+} FieldType;
+
+typedef struct {
+    HglStringView literal; /* text preceding the field */
+    HglStringView column;  /* column name or index of the field. Empty for a trailing literal */
+    FieldType type;
+    int bits;              /* width of integer types */
+} RowPart;
+
+typedef struct {
+    RowPart parts[MAX_ROW_FIELDS];
+    int n_parts;
+} RowTemplate;
+
+typedef struct {
+    const char *start;   /* start of value in the input file, or NULL if stored in the arena */
+    size_t arena_offset; /* offset of value in the arena (for unescaped values) */
+    size_t length;
+    bool is_string;      /* value was quoted */
+} Field;
+
+typedef struct {
+    Field fields[MAX_ROW_FIELDS];
+    int n_fields;
+    HglStringBuilder arena;
+} Record;
+
+typedef struct {
+    char *directive;         /* e.g. "@python" */
+    char **argv;             /* NULL-terminated command line. Scripts are written to its stdin */
+    size_t n_runs;
+    double startup_seconds;  /* total time until the first output (or exit) of its scripts */
+    double seconds;          /* total run time of its scripts */
+    size_t n_planned;        /* scripts counted by `--plan` */
+} Interpreter;
+
+typedef struct {
+    char *path;              /* relative to the working directory of gept if below it, else absolute */
+    bool contents;           /* the file was opened or executed, not just stat'ed */
+} TracedInput;
+
+typedef struct {
+    long nr;
+    int dirfd_arg;           /* index of the directory fd argument, or -1 */
+    int path_arg;            /* index of the path argument */
+    int flags_arg;           /* index of the `open` flags argument, or -1 */
+    bool contents;           /* the syscall reads the contents of the file */
+} TracedSyscall;
+
+typedef struct ScriptJob {
+    pid_t pid;
+    int stdout_fd;           /* read end of the script's stdout. -1 once EOF is reached */
+    HglStringBuilder result; /* output of the script */
+    HglStringBuilder *sink;  /* builder the output is spliced into... */
+    size_t offset;           /* ...at this offset */
+    HglStringView line;      /* directive line, for error messages */
+    bool holds_token;        /* a jobserver token was acquired for this job */
+    bool done;
+    double start_time;       /* see `now_seconds` */
+    bool has_output;         /* output has been read... */
+    double startup_time;     /* ...for the first time at this time */
+    Interpreter *interpreter;
+    size_t batch_entry;      /* batch entry the script belongs to, or SIZE_MAX */
+    size_t variant;          /* variant the script runs for, or SIZE_MAX if shared by all */
+    struct ScriptJob *same_as; /* job of a variant with the same cache key whose output is reused, or NULL */
+    bool is_pending;         /* waiting to be started by `jobs_dispatch`, with the script in `source` */
+    uint64_t block_hash;     /* XXH64 of the directive and the script, which identifies it in histories */
+    double expected_seconds; /* see `history_expect`. Longer scripts start first */
+    double seconds;          /* run time, once done */
+    bool is_cacheable;       /* output is stored in the cache under `cache_key` when done */
+    uint8_t cache_key[32];
+    int depth;               /* number of re-expanded scripts the job was generated by... */
+    struct ScriptJob *parent; /* ...the innermost of which is this one. NULL if none */
+    uint64_t output_hash;    /* XXH64 of `expanded_from`, for cycle detection */
+    HglStringBuilder expanded_from; /* raw output, if it was re-expanded into `result` */
+    HglStringBuilder source; /* with `--compile`: the script, which is run by the generator */
+    int notify_fd;           /* with `--trace-inputs`: seccomp listener of the script, or -1 */
+    TracedInput *inputs;     /* files the script read */
+    size_t n_inputs;
+} ScriptJob;
+
+typedef struct {
+    int read_fd;  /* non-blocking fd tokens are read from. -1 if there is no jobserver */
+    int write_fd; /* fd tokens are returned to */
+    pid_t owner;  /* only the process which acquired the tokens may return them */
+    char *tokens; /* acquired tokens. Make expects the same bytes back */
+    size_t n_tokens;
+} Jobserver;
+
+typedef struct {
+    char host[256];
+    char port[8];
+    char prefix[1024]; /* path prefix of the cache, without a trailing slash */
+    struct addrinfo *addrs; /* addresses of `host`, resolved once */
+    bool enabled;      /* cleared on the first failure */
+} RemoteCache;
+
+typedef struct {
+    char *input;     /* template path */
+    char *output;    /* output path. Also identifies the entry in timing reports */
+    double cost;     /* estimated cost in seconds, used for sharding */
+    bool measured;   /* `cost` comes from a previous timing report */
+    int shard;
+    double seconds;  /* time spent expanding the template, including its scripts */
+} BatchEntry;
+
+typedef struct {
+    uint64_t block_hash;  /* see `ScriptJob::block_hash` */
+    double seconds;       /* expected run time, averaged over previous runs */
+    bool is_current;      /* the block is still in the template. Others are dropped */
+} HistoryEntry;
+
+typedef struct {
+    char *path;           /* history file of the template in `--history` */
+    const char *template_path;
+    HistoryEntry *entries;
+    size_t n_entries;
+} History;
+
+typedef struct {
+    char *output;        /* path the expansion of the variant is written to */
+    char **defines;      /* `NAME=VALUE` strings, set in the environment of its scripts */
+    size_t n_defines;
+} Variant;
+
+typedef struct {
+    uint16_t counts[16];   /* number of codes of every length */
+    uint16_t symbols[288]; /* symbols, ordered by their code */
+    uint16_t fast[1 << INFLATE_FAST_BITS]; /* `length << 9 | symbol` of codes up to INFLATE_FAST_BITS long,
+                                              indexed by the next bits of input. 0 for longer codes */
+} InflateHuffman;
+
+typedef struct {
+    HglStringView line;    /* directive line, for error messages */
+    const char *path;
+    const uint8_t *in;     /* gzip file */
+    size_t in_size;
+    size_t in_pos;
+    uint64_t bits;         /* bit buffer. Deflate is read from the least significant bit */
+    int n_bits;
+    uint8_t *buf;          /* the last INFLATE_WINDOW_SIZE bytes output, followed by the current chunk */
+    size_t pos;            /* end of the output in `buf` */
+    size_t crc_pos;        /* end of the output in `buf` included in `crc` */
+    uint32_t crc;          /* CRC-32 of the output of the current gzip member... */
+    uint64_t n_out;        /* ...and its size */
+    int block_type;        /* type of the current deflate block, or -1 between blocks */
+    bool is_final_block;
+    size_t stored_left;    /* bytes left of a stored block */
+    size_t copy_length;    /* bytes left to copy of a match... */
+    size_t copy_distance;  /* ...from this far back */
+    bool done;
+    InflateHuffman lit;    /* literal/length code of the current block */
+    InflateHuffman dist;   /* distance code of the current block */
+} Inflater;
+
+typedef struct {
+    char *path;          /* path of the output file */
+    HglStringBuilder sb; /* buffered contents. Written to `path` once expansion is done... */
+    bool is_streamed;    /* ...unless they are streamed to a compiler with `--cc` */
+    char **extern_names; /* arrays defined by `@embed ... extern(NAME)` in this file */
+    size_t n_extern_names;
+} OutputSink;
+
+typedef struct {
+    pid_t pid;                  /* compiler process, or 0 once reaped */
+    int stdin_fd;               /* write end of its stdin. -1 once everything has been written */
+    const HglStringBuilder *sb; /* output streamed to the compiler... */
+    size_t n_streamed;          /* ...up to this offset, */
+    size_t next_job;            /* ...followed by the output of `jobs[next_job]` once done */
+    bool is_complete;           /* `sb` is fully expanded. Nothing is appended to it anymore */
+} CcStream;
+
+typedef struct {
+    size_t n_templates;
+    size_t n_reads;          /* files read by directives */
+    uint64_t read_bytes;
+    uint64_t output_min;     /* bounds of the output, excluding the output of scripts, */
+    uint64_t output_max;     /* @csv, @json, @lut and plugin directives */
+    uint64_t source_min;     /* bounds of the companion sources of `extern(NAME)` arrays */
+    uint64_t source_max;
+    size_t n_extern_arrays;
+    size_t n_unknown_output; /* directives whose output size can't be estimated */
+    size_t n_scripts;        /* script blocks. See `Interpreter::n_planned` */
+    size_t n_cache_hits;     /* scripts whose output is predicted to be in the cache */
+    size_t n_plugin_calls;
+    double seconds;          /* estimated runtime */
+    bool has_measured;       /* `seconds` is (partly) based on a timing report */
+} Plan;
 
 static const char **opt_infile;
 static const char **opt_firejail_path;
@@ -158,332 +677,6640 @@ static const char **opt_perl_path;
 static const char **opt_bash_path;
 static const char **opt_embed_fmt;
 static const char **opt_embed_delim;
+static const char **opt_embed_source;
+static int64_t     *opt_jobs;
+static const char **opt_batch;
+static const char **opt_variants;
+static const char **opt_shard;
+static const char **opt_timings;
+static const char **opt_timings_out;
+static const char **opt_history;
+static const char **opt_plugins;
+static const char **opt_cache_dir;
+static const char **opt_remote_cache;
+static int64_t     *opt_remote_cache_timeout;
+static int64_t     *opt_expand_depth;
+static bool        *opt_plan;
+static bool        *opt_cc;
+static const char **opt_compile;
+static const char **opt_interp;
+static bool        *opt_stats;
+static bool        *opt_trace_inputs;
+static const char **opt_depfile;
 static bool        *opt_yolo;
 static bool        *opt_help;
 
 static uint8_t scratch_buf[SCRATCH_BUFFER_SIZE]; // 128 MiB should be enough for most things
 
-int main(int argc, char *argv[])
-{
-    int err;
+static MappedFile **mapped_files;
+static size_t n_mapped_files;
 
-    /* parse cli arguments */
-    opt_infile        = hgl_flags_add_str("-i,--input", "Input file path", NULL, 0);
-    opt_firejail_path = hgl_flags_add_str("--firejail-path", "Alternative path to the firejail executable", NULL, 0);
-    opt_python_path   = hgl_flags_add_str("--python-path", "Alternative path to the python3 executable", NULL, 0);
-    opt_perl_path     = hgl_flags_add_str("--perl-path", "Alternative path to the perl executable", NULL, 0);
-    opt_bash_path     = hgl_flags_add_str("--bash-path", "Alternative path to the bash executable", NULL, 0);
-    opt_embed_fmt     = hgl_flags_add_str("--embed-fmt", "C-style format string used by the @embed directive.", "0x%02X", 0);
-    opt_embed_delim   = hgl_flags_add_str("--embed-delim", "Delimiter string used by the @embed directive", ", ", 0);
-    opt_yolo          = hgl_flags_add_bool("-yolo, --yolo", "Enable YOLO-mode. Run @python, @perl, and @bash in a non-sandboxed environment.", false, 0);
-    opt_help          = hgl_flags_add_bool("-h,--help", "Displays this help message", false, 0);
+static FileStat *file_stats;
+static size_t n_file_stats;
 
-    err = hgl_flags_parse(argc, argv);
-    if (err != 0 || *opt_help || *opt_infile == NULL) {
-        printf("GEPT - [GE]neric [P]rogrammable [T]emplates\n");
-        printf("Usage: %s [Options]\n", argv[0]);
-        hgl_flags_print();
-        return 1;
-    }
+static CompiledRegex **compiled_regexes;
+static size_t n_compiled_regexes;
 
-    int devnull = open("/dev/null", O_WRONLY);
-    GEPT_ASSERT(devnull != - 1, "Unable to open /dev/null for writing.\n");
+static OutputSink **output_sinks;
+static size_t n_output_sinks;
 
-    /* Check that firejail is installed if not running in YOLO-mode. */
-    if (!*opt_yolo) {
-        pid_t pid = fork();
+static Interpreter **interpreters;
+static size_t n_interpreters;
 
-        /* ======== child ======== */
-        if (pid == 0) {
-            /* redirect stdout to the void */
-            dup2(devnull, STDOUT_FILENO);
-            dup2(devnull, STDERR_FILENO);
+static ScriptJob **jobs;
+static size_t n_jobs;
+static ScriptJob *current_parent_job; /* job whose output is being re-expanded, or NULL */
+static int64_t n_running_jobs;
+static int64_t n_pending_jobs;
+static int64_t max_jobs = 1;
+static Jobserver jobserver = {.read_fd = -1, .write_fd = -1};
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-            char *exec_argv[3];
-            exec_argv[0] = "which";
-            exec_argv[1] = (*opt_firejail_path == NULL) ? "firejail": *opt_firejail_path;
-            exec_argv[2] = NULL;
-#pragma GCC diagnostic pop
+static BatchEntry *batch;
+static size_t n_batch;
+static size_t current_batch_entry = SIZE_MAX;
+static double jobs_poll_seconds; /* total time spent waiting for scripts */
 
-            /* on success `execve` doesn't return */
-            if (-1 == execvp(exec_argv[0], exec_argv)) {
-                fprintf(stderr, "ERROR (IN CHILD): failed to exec file. errno=%s\n",
-                        strerror(errno));
-                exit(1);
-            }
-            GEPT_ASSERT(0, "unreachable");
-        }
+static Variant *variants;
+static size_t n_variants;
+static char **varying_names; /* names defined differently by some variants */
+static size_t n_varying_names;
 
-        /* wait for process to terminate */
-        pid_t wait_pid;
-        int wstatus = 0;
-        while ((wait_pid = waitpid(pid, &wstatus, 0)) != pid) {
-            GEPT_ASSERT(wait_pid != -1, "waitpid() returned an error. errno=%s\n", strerror(errno));
-        }
-        if (WEXITSTATUS(wstatus) != 0) {
-            fprintf(stderr, "Error: GEPT could not find a firejail executable installed on \n"); 
-            fprintf(stderr, "       your system. Please make sure firejail is installed or, \n");
-            fprintf(stderr, "       if you know what you're doing, run GEPT in \"YOLO mode\" \n");
-            fprintf(stderr, "       by passing the `--yolo` option. \n");
-            exit(1);
-        }
-    }
+static History *histories; /* of every template, indexed like `batch` */
+static size_t n_histories;
 
-    /* open template file */
-    HglStringView input;
-    HglStringBuilder output = hgl_sb_make(.initial_capacity = 4096);
-    HglStringBuilder input_sb = hgl_sb_make(.initial_capacity = 4096);
-    err = hgl_sb_append_file(&input_sb, *opt_infile);
-    GEPT_ASSERT(err == 0, "Call to `hgl_sb_append_file` failed.\n");
-    input = hgl_sv_from_sb(&input_sb);
+static RemoteCache remote_cache;
 
-    /* generate output */
-    HglStringView line;
-    HglStringView tokens;
+static Plan plan; /* totals of `--plan` */
 
-    while (input.length > 0) {
+static char **cc_argv;       /* with `--cc`: compiler command line following `--` */
+static CcStream **cc_streams;
+static size_t n_cc_streams;
+static int cc_status;        /* exit status of the first compiler which failed, or 0 */
 
-        /* get next line */
-        line = hgl_sv_lchop_until(&input, '\n');
-        tokens = hgl_sv_ltrim(line);
+static char **depfile_inputs; /* files read by scripts, listed by `--depfile` */
+static size_t n_depfile_inputs;
 
-        /* regular code ==> append line to output */
-        if (!hgl_sv_starts_with(&tokens, "@")) {
-            hgl_sb_append_sv(&output, &line);
-            hgl_sb_append_char(&output, '\n');
-            continue;
-        }
+#ifdef TRACE_AUDIT_ARCH
+/* syscalls which read a path, reported to gept by the seccomp filter of `--trace-inputs` */
+static const TracedSyscall traced_syscalls[] = {
+#ifdef __NR_open
+    {.nr = __NR_open,        .dirfd_arg = -1, .path_arg = 0, .flags_arg = 1,  .contents = true},
+#endif
+    {.nr = __NR_openat,      .dirfd_arg = 0,  .path_arg = 1, .flags_arg = 2,  .contents = true},
+#ifdef __NR_openat2
+    {.nr = __NR_openat2,     .dirfd_arg = 0,  .path_arg = 1, .flags_arg = -1, .contents = true},
+#endif
+    {.nr = __NR_execve,      .dirfd_arg = -1, .path_arg = 0, .flags_arg = -1, .contents = true},
+    {.nr = __NR_execveat,    .dirfd_arg = 0,  .path_arg = 1, .flags_arg = -1, .contents = true},
+#ifdef __NR_stat
+    {.nr = __NR_stat,        .dirfd_arg = -1, .path_arg = 0, .flags_arg = -1, .contents = false},
+#endif
+#ifdef __NR_lstat
+    {.nr = __NR_lstat,       .dirfd_arg = -1, .path_arg = 0, .flags_arg = -1, .contents = false},
+#endif
+    {.nr = __NR_newfstatat,  .dirfd_arg = 0,  .path_arg = 1, .flags_arg = -1, .contents = false},
+#ifdef __NR_statx
+    {.nr = __NR_statx,       .dirfd_arg = 0,  .path_arg = 1, .flags_arg = -1, .contents = false},
+#endif
+#ifdef __NR_access
+    {.nr = __NR_access,      .dirfd_arg = -1, .path_arg = 0, .flags_arg = -1, .contents = false},
+#endif
+    {.nr = __NR_faccessat,   .dirfd_arg = 0,  .path_arg = 1, .flags_arg = -1, .contents = false},
+#ifdef __NR_faccessat2
+    {.nr = __NR_faccessat2,  .dirfd_arg = 0,  .path_arg = 1, .flags_arg = -1, .contents = false},
+#endif
+};
 
-        HglStringView directive = hgl_sv_lchop_until(&tokens, ' ');
+/* traced inputs below these are system files, assumed not to change between runs */
+static const char *trace_ignored_prefixes[] = {
+    "/proc/", "/sys/", "/dev/", "/usr/", "/bin/", "/sbin/", "/lib/", "/lib32/", "/lib64/", "/etc/ld.so.",
+};
+#endif
 
-        /* @sizeof directive */
-        if (hgl_sv_equals(directive, HGL_SV_LIT("@sizeof"))) {
-            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+static const GeptDirective **plugin_directives;
+static size_t n_plugin_directives;
+static void **plugin_handles;
+static size_t n_plugin_handles;
 
-            /* construct NULL-terminated path... */
-            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
-            memcpy(scratch_buf, path.start, path.length);
-            scratch_buf[path.length] = '\0';
+/* plugin directives may not shadow these */
+static const char *builtin_directives[] = {
+    "@embed", "@random", "@lines", "@include", "@csv", "@json", "@lut", "@hash", "@sizeof", "@mtime", "@mode", "@inode",
+    "@output", "@end",
+    "@bash", "@python", "@perl",
+};
 
-            /* open file in read binary mode */
-            int fd = open((char *)scratch_buf, O_RDWR);
-            GEPT_ASSERT_LINE(line, fd != -1, "Call to `open` failed.");
+static HglStringBuilder embed_table;          /* `--embed-fmt` + `--embed-delim` for every byte value */
+static uint32_t embed_table_offsets[256 + 1]; /* offset of every byte value's entry in `embed_table` */
 
-            /* get file size */
-            struct stat sb;
-            err = fstat(fd, &sb);
-            GEPT_ASSERT_LINE(line, err != -1, "Call to `fstat` failed.");
+/**
+ * Returns the output sink for `path`, creating it on first use. All segments
+ * routed to the same path are concatenated in template order.
+ */
+static OutputSink *output_sink_get(const char *path)
+{
+    for (size_t i = 0; i < n_output_sinks; i++) {
+        if (strcmp(output_sinks[i]->path, path) == 0) {
+            return output_sinks[i];
+        }
+    }
 
-            /* append size to output */
-            hgl_sb_append_fmt(&output, "    %zu", (size_t) sb.st_size);
+    OutputSink *sink = malloc(sizeof(OutputSink));
+    *sink = (OutputSink) {
+        .path = strdup(path),
+        .sb   = hgl_sb_make(.initial_capacity = 4096),
+    };
+    output_sinks = realloc(output_sinks, (n_output_sinks + 1) * sizeof(*output_sinks));
+    output_sinks[n_output_sinks++] = sink;
+    return sink;
+}
 
-            /* append remaining line to output */
-            hgl_sb_append_char(&output, ' ');
-            hgl_sb_append_sv(&output, &tokens);
-            hgl_sb_append_char(&output, '\n');
+/**
+ * Returns true if the file at `path` exists and its contents are exactly `size`
+ * bytes of `data`.
+ */
+static bool file_has_contents(const char *path, const char *data, size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
 
-            /* close file descriptor */
-            close(fd);
+    struct stat sb;
+    bool equal = (fstat(fd, &sb) == 0) && S_ISREG(sb.st_mode) && ((size_t) sb.st_size == size);
+    size_t offset = 0;
+    while (equal && offset < size) {
+        ssize_t n = read(fd, scratch_buf, SCRATCH_BUFFER_SIZE);
+        equal = (n > 0) && ((size_t) n <= size - offset) && (memcmp(scratch_buf, data + offset, n) == 0);
+        offset += (n > 0) ? (size_t) n : 0;
+    }
+    close(fd);
+    return equal;
+}
+
+/**
+ * Writes every output sink to its file. Files which already have the expected
+ * contents are left untouched, so their modification time (and anything that
+ * depends on it in a build) does not change.
+ */
+static void output_sinks_flush(void)
+{
+    for (size_t i = 0; i < n_output_sinks; i++) {
+        OutputSink *sink = output_sinks[i];
+        if (sink->is_streamed || file_has_contents(sink->path, sink->sb.cstr, sink->sb.length)) {
+            continue;
         }
+        FILE *fp = fopen(sink->path, "wb");
+        GEPT_ASSERT(fp != NULL, "Unable to open `%s` for writing. errno=%s\n", sink->path, strerror(errno));
+        size_t n_written_bytes = fwrite(sink->sb.cstr, 1, sink->sb.length, fp);
+        GEPT_ASSERT(n_written_bytes == sink->sb.length && fclose(fp) == 0,
+                    "Failed to write `%s`. errno=%s\n", sink->path, strerror(errno));
+    }
+}
 
-        /* @embed directive */
-        if (hgl_sv_equals(directive, HGL_SV_LIT("@embed"))) {
-            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+/**
+ * Frees all output sinks created by `output_sink_get`.
+ */
+static void output_sinks_release(void)
+{
+    for (size_t i = 0; i < n_output_sinks; i++) {
+        hgl_sb_destroy(&output_sinks[i]->sb);
+        free(output_sinks[i]->path);
+        for (size_t j = 0; j < output_sinks[i]->n_extern_names; j++) {
+            free(output_sinks[i]->extern_names[j]);
+        }
+        free(output_sinks[i]->extern_names);
+        free(output_sinks[i]);
+    }
+    free(output_sinks);
+    output_sinks   = NULL;
+    n_output_sinks = 0;
+}
 
-            /* construct NULL-terminated path... */
-            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
-            memcpy(scratch_buf, path.start, path.length);
-            scratch_buf[path.length] = '\0';
+/**
+ * Parses the next attribute of the form `name(arg0, arg1, ...)` from `tokens`.
+ * Arguments may be quoted with "" or '' in order to contain commas, parentheses
+ * or leading/trailing whitespace. Returns false if there are no more tokens.
+ */
+static bool parse_attribute(HglStringView line, HglStringView *tokens, Attribute *attr)
+{
+    *tokens = hgl_sv_ltrim(*tokens);
+    if (tokens->length == 0) {
+        return false;
+    }
 
-            /* has limit(n) ? */
-            int64_t limit = SCRATCH_BUFFER_SIZE;
-            tokens = hgl_sv_ltrim(tokens);
-            if (hgl_sv_lchop_if_starts_with(&tokens, "limit(")) {
-                limit = (int64_t) hgl_sv_lchop_u64(&tokens);
-                GEPT_ASSERT_LINE(line, hgl_sv_lchop_if_starts_with(&tokens, ")"), "Expected \')\'");
-            }
+    size_t i = 0;
+    while (i < tokens->length && (isalnum(tokens->start[i]) || tokens->start[i] == '-' ||
+                                  tokens->start[i] == '_')) {
+        i++;
+    }
+    attr->name   = hgl_sv_lchop(tokens, i);
+    attr->n_args = 0;
+    GEPT_ASSERT_LINE(line, attr->name.length > 0 && hgl_sv_lchop_if_starts_with(tokens, "("),
+                     "Expected an attribute of the form `name(...)`\n");
 
-            /* open file */
-            FILE *fp = fopen((char *) scratch_buf, "rb");
-            GEPT_ASSERT_LINE(line, fp != NULL, "Unable to open file `%s`", scratch_buf);
-
-            /* Get file size if possible */
-            fseek(fp, 0, SEEK_END);
-            int64_t file_size = ftell(fp);
-            rewind(fp);
-            if (file_size <= 0) {
-                file_size = limit;
-            } else {
-                file_size = (file_size < limit) ? file_size : limit;
-            }
-
-            /* read contents into scratch buffer */
-            ssize_t n_read_bytes = fread(scratch_buf, 1, file_size, fp);
-            (void) n_read_bytes;
-
-            /* generate embedding as a list of 8-bit unsigned integers */
-            hgl_sb_grow(&output, output.capacity + 6 * file_size); // probably enough
-            const int64_t n_bytes_per_row = 20;
-            const int64_t n_rows = file_size / n_bytes_per_row + 1;
-            for (int64_t row = 0; row < n_rows; row++) {
-                hgl_sb_append_cstr(&output, "    ");
-                for (int64_t i = 0; i < n_bytes_per_row && row*n_bytes_per_row + i < file_size; i++) {
-                    hgl_sb_append_fmt(&output, *opt_embed_fmt, scratch_buf[row * n_bytes_per_row + i]);
-                    hgl_sb_append_cstr(&output, *opt_embed_delim);
-                }
-                hgl_sb_append_char(&output, '\n');
-            }
+    *tokens = hgl_sv_ltrim(*tokens);
+    if (hgl_sv_lchop_if_starts_with(tokens, ")")) {
+        return true;
+    }
 
-            /* Remove last delimiter (typically `,`) */
-            hgl_sb_rchop(&output, 1 + strlen(*opt_embed_delim));
-            hgl_sb_append_char(&output, '\n');
+    while (true) {
+        GEPT_ASSERT_LINE(line, attr->n_args < MAX_ATTRIBUTE_ARGS,
+                         "Too many arguments to `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr->name));
+        *tokens = hgl_sv_ltrim(*tokens);
+        GEPT_ASSERT_LINE(line, tokens->length > 0, "Expected \')\'\n");
 
-            /* close file */
-            fclose(fp);
+        HglStringView arg;
+        char quote = tokens->start[0];
+        if (quote == '"' || quote == '\'') {
+            const char *end = memchr(tokens->start + 1, quote, tokens->length - 1);
+            GEPT_ASSERT_LINE(line, end != NULL, "Missing terminating %c\n", quote);
+            arg = hgl_sv_from(tokens->start + 1, end - tokens->start - 1);
+            hgl_sv_lchop(tokens, end - tokens->start + 1);
+        } else {
+            int depth = 0;
+            for (i = 0; i < tokens->length; i++) {
+                char c = tokens->start[i];
+                if (depth == 0 && (c == ',' || c == ')')) break;
+                if (c == '(') depth++;
+                if (c == ')') depth--;
+            }
+            arg = hgl_sv_lchop(tokens, i);
+            while (arg.length > 0 && isspace(arg.start[arg.length - 1])) {
+                arg.length--;
+            }
         }
+        attr->args[attr->n_args++] = arg;
 
-        /* @include directive */
-        if (hgl_sv_equals(directive, HGL_SV_LIT("@include"))) {
-            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
-
-            /* construct NULL-terminated path... */
-            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
-            memcpy(scratch_buf, path.start, path.length);
-            scratch_buf[path.length] = '\0';
-
-            /* append file */
-            hgl_sb_append_file(&output, (char *)scratch_buf);
+        *tokens = hgl_sv_ltrim(*tokens);
+        if (hgl_sv_lchop_if_starts_with(tokens, ")")) {
+            return true;
         }
+        GEPT_ASSERT_LINE(line, hgl_sv_lchop_if_starts_with(tokens, ","), "Expected \',\' or \')\'\n");
+    }
+}
 
-        /* @bash and @python directives */
-        if (hgl_sv_equals(directive, HGL_SV_LIT("@bash")) ||
-            hgl_sv_equals(directive, HGL_SV_LIT("@perl")) ||
-            hgl_sv_equals(directive, HGL_SV_LIT("@python"))) {
-            HglStringBuilder source_code = hgl_sb_make(.initial_capacity = 4096);
-
-            while (input.length > 0) {
-                line = hgl_sv_lchop_until(&input, '\n');
-                tokens = hgl_sv_ltrim(line);
+/**
+ * Returns the file at `path`, mapped into memory. Files are mapped once and
+ * cached for the duration of the run, and the returned pointer stays valid until
+ * `mapped_files_release`. Returns NULL if the file can't be opened.
+ */
+static MappedFile *mapped_file_get(const char *path)
+{
+    for (size_t i = 0; i < n_mapped_files; i++) {
+        if (strcmp(mapped_files[i]->path, path) == 0) {
+            return mapped_files[i];
+        }
+    }
 
-                if (hgl_sv_starts_with(&tokens, "@end")) {
-                    break;
-                } else {
-                    hgl_sb_append_sv(&source_code, &line);
-                    hgl_sb_append_char(&source_code, '\n');
-                }
-            }
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
 
-            GEPT_ASSERT(input.length > 0, "Missing terminating `@end` token for matching `"
-                        HGL_SV_FMT"` token", HGL_SV_ARG(directive));
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        close(fd);
+        return NULL;
+    }
 
-            int pipes[2][2]; // {{input read end, input write end},
-                             //  {output read end, output write end}}
-            GEPT_ASSERT(pipe(pipes[0]) == 0, "Failed to create pipes");
-            GEPT_ASSERT(pipe(pipes[1]) == 0, "Failed to create pipes");
+    MappedFile *mf = malloc(sizeof(MappedFile));
+    *mf = (MappedFile) {
+        .path = strdup(path),
+        .data = NULL,
+        .size = 0,
+    };
 
-            pid_t pid = fork();
+    if (S_ISREG(sb.st_mode) && sb.st_size > 0) {
+        void *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        GEPT_ASSERT(data != MAP_FAILED, "Call to `mmap` failed for `%s`. errno=%s\n",
+                    path, strerror(errno));
+        mf->data      = data;
+        mf->size      = sb.st_size;
+        mf->is_mapped = true;
+    } else if (!S_ISREG(sb.st_mode)) {
+        /* pipes, fifos etc. can't be mapped. Read until EOF instead, not through
+         * `scratch_buf`, which `path` may point into */
+        HglStringBuilder sb_data = hgl_sb_make(.initial_capacity = 4096);
+        char buf[65536];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            hgl_sb_append(&sb_data, buf, n);
+        }
+        mf->data = sb_data.cstr;
+        mf->size = sb_data.length;
+    }
+    close(fd);
 
-            /* ======== child ======== */
-            if (pid == 0) {
-                /* Replace stdin & stdout with respective pipe and close unused ends */
-                close(pipes[0][1]);
-                close(pipes[1][0]);
-                dup2(pipes[0][0], STDIN_FILENO);
-                dup2(pipes[1][1], STDOUT_FILENO);
-                //dup2(devnull, STDERR_FILENO);
+    mapped_files = realloc(mapped_files, (n_mapped_files + 1) * sizeof(*mapped_files));
+    mapped_files[n_mapped_files++] = mf;
+    return mf;
+}
 
-                char *exec_argv[32];
-                int exec_argv_idx = 0;
+/**
+ * Unmaps and frees all files mapped by `mapped_file_get`.
+ */
+static void mapped_files_release(void)
+{
+    for (size_t i = 0; i < n_mapped_files; i++) {
+        MappedFile *mf = mapped_files[i];
+        if (mf->is_mapped) {
+            munmap(mf->data, mf->size);
+        } else {
+            free(mf->data);
+        }
+        free(mf->line_offsets);
+        free(mf->path);
+        free(mf);
+    }
+    free(mapped_files);
+    mapped_files   = NULL;
+    n_mapped_files = 0;
+}
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-                /* There is no reasonable const-correct way to do this*/
+/**
+ * Returns the metadata of the file at `path`, or NULL if it can't be stat'ed. Every
+ * path is stat'ed once per run, with a single `statx` (falling back to `stat` where
+ * the kernel or the headers lack it). Files aren't opened, so no permissions beyond search
+ * permission on the directories are needed. The returned pointer is valid until
+ * the next call.
+ */
+static FileStat *file_stat_get(const char *path)
+{
+    for (size_t i = 0; i < n_file_stats; i++) {
+        if (strcmp(file_stats[i].path, path) == 0) {
+            return &file_stats[i];
+        }
+    }
 
-                /* 
-                 * Run in a read-only view of the file system unless explicitly told "YOLO"
-                 * by the user.
-                 *
-                 * TODO figure out what other flags to use.
-                 */
-                if (!*opt_yolo) {
-                    exec_argv[exec_argv_idx++] = (*opt_firejail_path == NULL) ? "firejail": *opt_firejail_path;
-                    exec_argv[exec_argv_idx++] = "--read-only=~/";
-                    exec_argv[exec_argv_idx++] = "--caps.drop=all";
-                    exec_argv[exec_argv_idx++] = "--protocol=netlink";
-                    exec_argv[exec_argv_idx++] = "--quiet";
-                }
+    FileStat fs = {0};
+    bool ok = false;
+#if defined(STATX_BASIC_STATS) && defined(__NR_statx)
+    /* the raw syscall, since musl before 1.2.5 has no statx wrapper */
+    static bool has_statx = true;
+    if (has_statx) {
+        struct statx stx;
+        if (syscall(__NR_statx, AT_FDCWD, path, 0, STATX_SIZE | STATX_MTIME | STATX_MODE | STATX_INO, &stx) == 0) {
+            fs.size  = stx.stx_size;
+            fs.mtime = stx.stx_mtime.tv_sec;
+            fs.mode  = stx.stx_mode & 07777;
+            fs.inode = stx.stx_ino;
+            ok = true;
+        } else if (errno == ENOSYS) {
+            has_statx = false;
+        } else {
+            return NULL;
+        }
+    }
+#endif
+    if (!ok) {
+        struct stat sb;
+        if (stat(path, &sb) != 0) {
+            return NULL;
+        }
+        fs.size  = (uint64_t) sb.st_size;
+        fs.mtime = (int64_t) sb.st_mtime;
+        fs.mode  = (uint32_t) (sb.st_mode & 07777);
+        fs.inode = (uint64_t) sb.st_ino;
+    }
 
-                /* select which executable to run */
-                if (hgl_sv_equals(directive, HGL_SV_LIT("@bash"))) {
-                    exec_argv[exec_argv_idx++]= (*opt_bash_path == NULL) ? "bash" : *opt_bash_path;
-                    exec_argv[exec_argv_idx++]= "--norc";
-                    exec_argv[exec_argv_idx++]= "--noprofile";
-                    exec_argv[exec_argv_idx++]= "-r";
-                    exec_argv[exec_argv_idx++]= "-s";
-                    exec_argv[exec_argv_idx++]= NULL;
-                } else if (hgl_sv_equals(directive, HGL_SV_LIT("@python"))) {
-                    exec_argv[exec_argv_idx++]= (*opt_python_path == NULL) ? "python3" : *opt_python_path;
-                    exec_argv[exec_argv_idx++]= NULL;
-                } else if (hgl_sv_equals(directive, HGL_SV_LIT("@perl"))) {
-                    exec_argv[exec_argv_idx++]= (*opt_perl_path == NULL) ? "perl" : *opt_perl_path;
-                    exec_argv[exec_argv_idx++]= NULL;
-                }
-#pragma GCC diagnostic pop
+    fs.path = strdup(path);
+    file_stats = realloc(file_stats, (n_file_stats + 1) * sizeof(*file_stats));
+    file_stats[n_file_stats] = fs;
+    return &file_stats[n_file_stats++];
+}
 
-                /* on success `execve` doesn't return */
-                if (-1 == execvp(exec_argv[0], exec_argv)) {
-                    fprintf(stderr, "ERROR (IN CHILD): failed to exec file. errno=%s\n",
-                            strerror(errno));
-                    exit(1);
-                }
-                GEPT_ASSERT(0, "unreachable");
-            }
+/**
+ * Frees the file metadata cache.
+ */
+static void file_stats_release(void)
+{
+    for (size_t i = 0; i < n_file_stats; i++) {
+        free(file_stats[i].path);
+    }
+    free(file_stats);
+    file_stats   = NULL;
+    n_file_stats = 0;
+}
 
-            /* ======== parent ======== */
+/**
+ * Builds the line index of `mf` if it hasn't been built already.
+ */
+static void mapped_file_index_lines(MappedFile *mf)
+{
+    if (mf->line_offsets != NULL || mf->size == 0) {
+        return;
+    }
 
-            /* close unused ends of pipes */
-            close(pipes[0][0]);
-            close(pipes[1][1]);
+    size_t capacity = 1024;
+    mf->line_offsets = malloc(capacity * sizeof(size_t));
+    mf->line_offsets[mf->n_lines++] = 0;
 
-            /*
-             * Write source code contents on the stdin of the process then
-             * immediately close the pipe.
-             */
-            ssize_t n_written_bytes = write(pipes[0][1], source_code.cstr, source_code.length);
-            (void) n_written_bytes;
-            close(pipes[0][1]);
+    const char *p   = mf->data;
+    const char *end = mf->data + mf->size;
+    while ((p = memchr(p, '\n', end - p)) != NULL && ++p < end) {
+        if (mf->n_lines == capacity) {
+            capacity *= 2;
+            mf->line_offsets = realloc(mf->line_offsets, capacity * sizeof(size_t));
+        }
+        mf->line_offsets[mf->n_lines++] = p - mf->data;
+    }
+}
 
-            /* wait for process to terminate */
-            pid_t wait_pid;
-            int wstatus = 0;
-            while ((wait_pid = waitpid(pid, &wstatus, 0)) != pid) {
-                GEPT_ASSERT(wait_pid != -1, "Child process returned an error");
-            }
-            GEPT_ASSERT(WEXITSTATUS(wstatus) == 0, "Child process exited with the error code: %d\n",
-                        WEXITSTATUS(wstatus));
+/**
+ * Returns the (0-indexed) line in `mf` containing the byte at `offset`.
+ */
+static size_t mapped_file_line_of(MappedFile *mf, size_t offset)
+{
+    mapped_file_index_lines(mf);
+    size_t lo = 0;
+    size_t hi = mf->n_lines;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mf->line_offsets[mid] <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
 
+/**
+ * Returns a view of lines [first, last) (0-indexed) of `mf`.
+ */
+static HglStringView mapped_file_lines(MappedFile *mf, size_t first, size_t last)
+{
+    mapped_file_index_lines(mf);
+    if (first > mf->n_lines) first = mf->n_lines;
+    if (last > mf->n_lines) last = mf->n_lines;
+    if (last < first) last = first;
+    size_t start = (first < mf->n_lines) ? mf->line_offsets[first] : mf->size;
+    size_t end   = (last < mf->n_lines) ? mf->line_offsets[last] : mf->size;
+    return hgl_sv_from(mf->data + start, end - start);
+}
 
-            /* read output, and close the pipe */
-            ssize_t n_read_bytes = read(pipes[1][0], scratch_buf, sizeof(scratch_buf) - 1);
-            close(pipes[1][0]);
+/**
+ * Finds the first occurrence of `needle` in `hay`. Candidate positions are found
+ * 16 bytes at a time by matching the first and last byte of `needle` in parallel.
+ */
+static const char *find_marker(const char *hay, size_t hay_len, const char *needle, size_t needle_len)
+{
+    if (needle_len == 0) {
+        return hay;
+    }
+    if (needle_len > hay_len) {
+        return NULL;
+    }
 
-            hgl_sb_append(&output, (char *)scratch_buf, n_read_bytes);
-            hgl_sb_destroy(&source_code);
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[needle_len - 1]);
+    for (; i + needle_len - 1 + 16 <= hay_len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *) (hay + i));
+        __m128i block_last  = _mm_loadu_si128((const __m128i *) (hay + i + needle_len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                                        _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(hay + i + bit, needle, needle_len) == 0) {
+                return hay + i + bit;
+            }
+            mask &= mask - 1;
         }
     }
+#endif
+    return memmem(hay + i, hay_len - i, needle, needle_len);
+}
 
-    /* print output to stdout */
-    printf(HGL_SB_FMT "\n", HGL_SB_ARG(output));
+/**
+ * Returns the compiled (POSIX extended) regex for `pattern`. Regexes are compiled
+ * once and cached for the duration of the run.
+ */
+static regex_t *regex_get(HglStringView line, HglStringView pattern)
+{
+    for (size_t i = 0; i < n_compiled_regexes; i++) {
+        if (hgl_sv_equals_cstr(pattern, compiled_regexes[i]->pattern)) {
+            return &compiled_regexes[i]->re;
+        }
+    }
 
-    /* cleanup */
-    hgl_sb_destroy(&input_sb);
-    hgl_sb_destroy(&output);
+    CompiledRegex *cr = malloc(sizeof(CompiledRegex));
+    cr->pattern = hgl_sv_make_cstr_copy(pattern, NULL);
+    int err = regcomp(&cr->re, cr->pattern, REG_EXTENDED);
+    GEPT_ASSERT_LINE(line, err == 0, "Could not compile regex \"%s\"\n", cr->pattern);
 
-    close(devnull);
+    compiled_regexes = realloc(compiled_regexes, (n_compiled_regexes + 1) * sizeof(*compiled_regexes));
+    compiled_regexes[n_compiled_regexes++] = cr;
+    return &cr->re;
+}
 
-    return 0;
+/**
+ * Frees all regexes compiled by `regex_get`.
+ */
+static void regexes_release(void)
+{
+    for (size_t i = 0; i < n_compiled_regexes; i++) {
+        regfree(&compiled_regexes[i]->re);
+        free(compiled_regexes[i]->pattern);
+        free(compiled_regexes[i]);
+    }
+    free(compiled_regexes);
+    compiled_regexes   = NULL;
+    n_compiled_regexes = 0;
+}
+
+/**
+ * Replaces all matches of `re` in the NULL-terminated `sb` with `replacement`,
+ * using `tmp` as scratch space. `\0` through `\9` in `replacement` refer to the
+ * match and its subexpressions.
+ */
+static void replace_all(HglStringBuilder *sb, HglStringBuilder *tmp, regex_t *re, HglStringView replacement)
+{
+    regmatch_t m[10];
+    size_t offset = 0;
+    int eflags = 0;
+
+    hgl_sb_clear(tmp);
+    while (offset <= sb->length && regexec(re, sb->cstr + offset, 10, m, eflags) == 0) {
+        const char *base = sb->cstr + offset;
+        hgl_sb_append(tmp, base, m[0].rm_so);
+        for (size_t i = 0; i < replacement.length; i++) {
+            char c = replacement.start[i];
+            if (c == '\\' && i + 1 < replacement.length) {
+                char next = replacement.start[++i];
+                if (next >= '0' && next <= '9') {
+                    regmatch_t sub = m[next - '0'];
+                    if (sub.rm_so != -1) {
+                        hgl_sb_append(tmp, base + sub.rm_so, sub.rm_eo - sub.rm_so);
+                    }
+                    continue;
+                }
+                c = next;
+            }
+            hgl_sb_append_char(tmp, c);
+        }
+
+        /* empty match: copy one character to guarantee progress */
+        if (m[0].rm_eo == m[0].rm_so) {
+            if (base[m[0].rm_eo] == '\0') {
+                offset = sb->length + 1;
+                break;
+            }
+            hgl_sb_append_char(tmp, base[m[0].rm_eo]);
+            m[0].rm_eo++;
+        }
+        offset += m[0].rm_eo;
+        eflags = REG_NOTBOL;
+    }
+    if (offset < sb->length) {
+        hgl_sb_append(tmp, sb->cstr + offset, sb->length - offset);
+    }
+
+    HglStringBuilder swap = *sb;
+    *sb  = *tmp;
+    *tmp = swap;
+}
+
+/**
+ * Removes comments from the NULL-terminated `sb`. `in_block_comment` carries
+ * the state of multi-line comments over from the previous line. Shell-style
+ * comments start with a `#` at the start of a word, like in sh, so `$#`, `${#x}`
+ * and `a#b` are kept. Single quotes follow shell rules there: no escapes inside.
+ */
+static void strip_comments(HglStringBuilder *sb, CommentStyle style, bool *in_block_comment)
+{
+    size_t w = 0;
+    char quote = '\0';
+    char prev  = ' ';
+    bool stripped = *in_block_comment;
+    for (size_t r = 0; r < sb->length; prev = sb->cstr[r++]) {
+        char c    = sb->cstr[r];
+        char next = sb->cstr[r + 1];
+
+        if (*in_block_comment) {
+            if (c == '*' && next == '/') {
+                *in_block_comment = false;
+                r++;
+            }
+            continue;
+        }
+
+        if (quote != '\0') {
+            sb->cstr[w++] = c;
+            bool has_escapes = (style != COMMENT_STYLE_SH || quote == '"');
+            if (has_escapes && c == '\\' && next != '\0') {
+                sb->cstr[w++] = next;
+                r++;
+            } else if (c == quote) {
+                quote = '\0';
+            }
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (style == COMMENT_STYLE_SH && c == '\\' && next != '\0') {
+            sb->cstr[w++] = c;
+            sb->cstr[w++] = next;
+            r++;
+            continue;
+        } else if (style == COMMENT_STYLE_C && c == '/' && next == '/') {
+            stripped = true;
+            break;
+        } else if (style == COMMENT_STYLE_C && c == '/' && next == '*') {
+            *in_block_comment = true;
+            stripped = true;
+            r++;
+            continue;
+        } else if (style == COMMENT_STYLE_SH && c == '#' && isspace((unsigned char) prev)) {
+            stripped = true;
+            break;
+        }
+        sb->cstr[w++] = c;
+    }
+
+    /* drop trailing whitespace left behind by the removed comment */
+    while (stripped && w > 0 && isspace(sb->cstr[w - 1])) {
+        w--;
+    }
+    sb->length = w;
+    sb->cstr[w] = '\0';
+}
+
+/**
+ * Appends `content` to `output` line by line, passing each line through
+ * `filters` in order. Done in a single pass over `content`.
+ */
+static void append_filtered(HglStringBuilder *output, HglStringView content, Filter *filters, int n_filters)
+{
+    if (n_filters == 0) {
+        hgl_sb_append_sv(output, &content);
+        return;
+    }
+
+    HglStringBuilder line_buf = hgl_sb_make(.initial_capacity = 4096);
+    HglStringBuilder tmp_buf  = hgl_sb_make(.initial_capacity = 4096);
+    bool in_block_comment = false;
+
+    const char *p   = content.start;
+    const char *end = content.start + content.length;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        bool has_newline = (eol != NULL);
+        if (!has_newline) {
+            eol = end;
+        }
+
+        hgl_sb_clear(&line_buf);
+        hgl_sb_append(&line_buf, p, eol - p);
+        p = has_newline ? eol + 1 : end;
+
+        bool keep = true;
+        for (int i = 0; i < n_filters && keep; i++) {
+            Filter *f = &filters[i];
+            switch (f->kind) {
+                case FILTER_MATCH: {
+                    keep = (regexec(f->re, line_buf.cstr, 0, NULL, 0) == 0);
+                } break;
+                case FILTER_EXCLUDE: {
+                    keep = (regexec(f->re, line_buf.cstr, 0, NULL, 0) != 0);
+                } break;
+                case FILTER_REPLACE: {
+                    replace_all(&line_buf, &tmp_buf, f->re, f->replacement);
+                } break;
+                case FILTER_STRIP_COMMENTS: {
+                    size_t old_length = line_buf.length;
+                    bool was_in_block_comment = in_block_comment;
+                    strip_comments(&line_buf, f->comment_style, &in_block_comment);
+
+                    /* drop lines that consisted only of a comment */
+                    if (line_buf.length != old_length || was_in_block_comment) {
+                        HglStringView rest = hgl_sv_ltrim(hgl_sv_from_sb(&line_buf));
+                        keep = (rest.length > 0);
+                    }
+                } break;
+            }
+        }
+
+        if (keep) {
+            hgl_sb_append(output, line_buf.cstr, line_buf.length);
+            if (has_newline) {
+                hgl_sb_append_char(output, '\n');
+            }
+        }
+    }
+
+    hgl_sb_destroy(&line_buf);
+    hgl_sb_destroy(&tmp_buf);
+}
+
+/**
+ * Reads the body of the multi-line directive `directive` from `input`, up until
+ * the terminating `@end`.
+ */
+static HglStringBuilder read_block(HglStringView *input, HglStringView directive)
+{
+    HglStringBuilder body = hgl_sb_make(.initial_capacity = 4096);
+
+    while (input->length > 0) {
+        HglStringView line   = hgl_sv_lchop_until(input, '\n');
+        HglStringView tokens = hgl_sv_ltrim(line);
+
+        if (hgl_sv_starts_with(&tokens, "@end")) {
+            return body;
+        }
+        hgl_sb_append_sv(&body, &line);
+        hgl_sb_append_char(&body, '\n');
+    }
+
+    GEPT_ASSERT(false, "Missing terminating `@end` token for matching `"
+                HGL_SV_FMT"` token\n", HGL_SV_ARG(directive));
+    return body;
+}
+
+/**
+ * Appends `n` bytes of `s` to `sb` as a C string literal. Bytes that need escaping are
+ * looked up in a table, everything in between is copied in bulk.
+ */
+static void append_c_string(HglStringBuilder *sb, const char *s, size_t n)
+{
+    static char escapes[256][5];
+    static bool escapes_initialized = false;
+    if (!escapes_initialized) {
+        for (int c = 0; c < 256; c++) {
+            if (c < 0x20 || c == 0x7F) {
+                snprintf(escapes[c], sizeof(escapes[c]), "\\%03o", c);
+            }
+        }
+        memcpy(escapes['\n'], "\\n", 3);
+        memcpy(escapes['\t'], "\\t", 3);
+        memcpy(escapes['\r'], "\\r", 3);
+        memcpy(escapes['"'],  "\\\"", 3);
+        memcpy(escapes['\\'], "\\\\", 3);
+        escapes_initialized = true;
+    }
+
+    hgl_sb_append_char(sb, '"');
+    size_t run_start = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t c = (uint8_t) s[i];
+        bool is_trigraph = (c == '?' && i > 0 && s[i - 1] == '?');
+        if (escapes[c][0] == '\0' && !is_trigraph) {
+            continue;
+        }
+        hgl_sb_append(sb, s + run_start, i - run_start);
+        hgl_sb_append_cstr(sb, is_trigraph ? "\\?" : escapes[c]);
+        run_start = i + 1;
+    }
+    hgl_sb_append(sb, s + run_start, n - run_start);
+    hgl_sb_append_char(sb, '"');
+}
+
+/**
+ * Appends the lines of `mf` (without their line terminators) as C string literals,
+ * one per row and separated by commas, for use in a `const char *[]` initializer.
+ * With `count_name`, a `#define` of the number of lines precedes them.
+ */
+static void append_lines(HglStringBuilder *sb, MappedFile *mf, HglStringView count_name)
+{
+    mapped_file_index_lines(mf);
+    if (count_name.length > 0) {
+        hgl_sb_append_fmt(sb, "#define "HGL_SV_FMT" %zu\n", HGL_SV_ARG(count_name), mf->n_lines);
+    }
+
+    hgl_sb_grow_by_policy(sb, sb->length + mf->size + 8 * mf->n_lines + 1, HGL_SB_DEFAULT_GROWTH_POLICY);
+    for (size_t i = 0; i < mf->n_lines; i++) {
+        size_t start = mf->line_offsets[i];
+        size_t end   = (i + 1 < mf->n_lines) ? mf->line_offsets[i + 1] : mf->size;
+        if (end > start && mf->data[end - 1] == '\n') {
+            end--;
+        }
+        hgl_sb_append_cstr(sb, "    ");
+        append_c_string(sb, mf->data + start, end - start);
+        hgl_sb_append_cstr(sb, (i + 1 < mf->n_lines) ? ",\n" : "\n");
+    }
+}
+
+/**
+ * Compiles a row template. Fields are written as `{column}` or `{column:type}`,
+ * where `column` is a column name (or index) and `type` is one of raw (default), str,
+ * i8-i64, int, u8-u64, uint, x8-x64, hex, f32, float, f64, double or bool. `{{` is a
+ * literal `{`. Any other `{` is copied as is.
+ */
+static void row_template_compile(HglStringView line, HglStringView body, RowTemplate *rt)
+{
+    static const struct { const char *name; FieldType type; int bits; } types[] = {
+        {"raw", FIELD_RAW,    0}, {"str",    FIELD_STR,     0}, {"bool", FIELD_BOOL,  0},
+        {"i8",  FIELD_INT,    8}, {"i16",    FIELD_INT,    16}, {"i32",  FIELD_INT,  32},
+        {"i64", FIELD_INT,   64}, {"int",    FIELD_INT,    32}, {"u8",   FIELD_UINT,  8},
+        {"u16", FIELD_UINT,  16}, {"u32",    FIELD_UINT,   32}, {"u64",  FIELD_UINT, 64},
+        {"uint", FIELD_UINT, 32}, {"x8",     FIELD_HEX,     8}, {"x16",  FIELD_HEX,  16},
+        {"x32", FIELD_HEX,   32}, {"x64",    FIELD_HEX,    64}, {"hex",  FIELD_HEX,  64},
+        {"f32", FIELD_FLOAT,  0}, {"float",  FIELD_FLOAT,   0}, {"f64",  FIELD_DOUBLE, 0},
+        {"double", FIELD_DOUBLE, 0},
+    };
+
+    rt->n_parts = 0;
+    const char *literal_start = body.start;
+    const char *p   = body.start;
+    const char *end = body.start + body.length;
+    while (p < end) {
+        if (*p != '{') {
+            p++;
+            continue;
+        }
+
+        /* `{{` ==> literal `{` */
+        if (p + 1 < end && p[1] == '{') {
+            GEPT_ASSERT_LINE(line, rt->n_parts < MAX_ROW_FIELDS, "Too many fields in row template\n");
+            rt->parts[rt->n_parts++] = (RowPart) {
+                .literal = hgl_sv_from(literal_start, p + 1 - literal_start),
+            };
+            p += 2;
+            literal_start = p;
+            continue;
+        }
+
+        const char *q = p + 1;
+        while (q < end && (isalnum(*q) || *q == '_' || *q == '-' || *q == '.')) q++;
+        HglStringView column = hgl_sv_from(p + 1, q - p - 1);
+        HglStringView type   = HGL_SV_LIT("raw");
+        if (q < end && *q == ':') {
+            const char *type_start = ++q;
+            while (q < end && isalnum(*q)) q++;
+            type = hgl_sv_from(type_start, q - type_start);
+        }
+        if (column.length == 0 || q >= end || *q != '}') {
+            p++;
+            continue;
+        }
+
+        GEPT_ASSERT_LINE(line, rt->n_parts < MAX_ROW_FIELDS, "Too many fields in row template\n");
+        RowPart *part = &rt->parts[rt->n_parts++];
+        *part = (RowPart) {
+            .literal = hgl_sv_from(literal_start, p - literal_start),
+            .column  = column,
+            .type    = FIELD_RAW,
+            .bits    = -1,
+        };
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+            if (hgl_sv_equals_cstr(type, types[i].name)) {
+                part->type = types[i].type;
+                part->bits = types[i].bits;
+            }
+        }
+        GEPT_ASSERT_LINE(line, part->bits != -1, "Unknown field type `"HGL_SV_FMT"`\n", HGL_SV_ARG(type));
+
+        p = q + 1;
+        literal_start = p;
+    }
+
+    GEPT_ASSERT_LINE(line, rt->n_parts < MAX_ROW_FIELDS, "Too many fields in row template\n");
+    rt->parts[rt->n_parts++] = (RowPart) {
+        .literal = hgl_sv_from(literal_start, end - literal_start),
+    };
+}
+
+/**
+ * Returns the value of field `i` of record `r`.
+ */
+static HglStringView record_value(Record *r, int i)
+{
+    Field *f = &r->fields[i];
+    return hgl_sv_from((f->start != NULL) ? f->start : r->arena.cstr + f->arena_offset, f->length);
+}
+
+/**
+ * Appends a field to `r`. If `start` is NULL, the value is the last `length` bytes
+ * of the arena.
+ */
+static void record_push(HglStringView line, Record *r, const char *start, size_t length, bool is_string)
+{
+    GEPT_ASSERT_LINE(line, r->n_fields < MAX_ROW_FIELDS, "Too many fields in record\n");
+    r->fields[r->n_fields++] = (Field) {
+        .start        = start,
+        .arena_offset = r->arena.length - ((start == NULL) ? length : 0),
+        .length       = length,
+        .is_string    = is_string,
+    };
+}
+
+/**
+ * Appends `value` to `sb`, formatted as `part->type`. Values that don't fit the
+ * type are reported as errors. `path` and `n_record` are used for error reporting.
+ */
+static void append_typed_field(HglStringView line, HglStringBuilder *sb, RowPart *part,
+                               HglStringView value, bool is_string, const char *path, size_t n_record)
+{
+    char buf[64];
+    char *endptr;
+
+    if (part->type == FIELD_RAW) {
+        hgl_sb_append_sv(sb, &value);
+        return;
+    }
+    if (part->type == FIELD_STR) {
+        if (!is_string && hgl_sv_equals(value, HGL_SV_LIT("null"))) {
+            hgl_sb_append_cstr(sb, "NULL");
+        } else {
+            append_c_string(sb, value.start, value.length);
+        }
+        return;
+    }
+
+    /* numeric and boolean types ignore surrounding whitespace */
+    value = hgl_sv_ltrim(value);
+    while (value.length > 0 && isspace(value.start[value.length - 1])) {
+        value.length--;
+    }
+    bool ok = (value.length > 0 && value.length < sizeof(buf));
+    if (ok) {
+        memcpy(buf, value.start, value.length);
+        buf[value.length] = '\0';
+    }
+
+    switch (part->type) {
+        case FIELD_INT: {
+            bool is_hex = ok && (strncmp(buf + (buf[0] == '-'), "0x", 2) == 0 ||
+                                 strncmp(buf + (buf[0] == '-'), "0X", 2) == 0);
+            errno = 0;
+            long long v = ok ? strtoll(buf, &endptr, is_hex ? 16 : 10) : 0;
+            long long max = (part->bits == 64) ? INT64_MAX : (1LL << (part->bits - 1)) - 1;
+            ok = ok && *endptr == '\0' && errno == 0 && v <= max && v >= -max - 1;
+            if (ok) hgl_sb_append_fmt(sb, "%lld", v);
+        } break;
+        case FIELD_UINT:
+        case FIELD_HEX: {
+            bool is_hex = ok && (strncmp(buf, "0x", 2) == 0 || strncmp(buf, "0X", 2) == 0);
+            errno = 0;
+            unsigned long long v = ok ? strtoull(buf, &endptr, is_hex ? 16 : 10) : 0;
+            unsigned long long max = (part->bits == 64) ? UINT64_MAX : (1ULL << part->bits) - 1;
+            ok = ok && buf[0] != '-' && *endptr == '\0' && errno == 0 && v <= max;
+            if (ok && part->type == FIELD_UINT) hgl_sb_append_fmt(sb, "%llu", v);
+            if (ok && part->type == FIELD_HEX) hgl_sb_append_fmt(sb, "0x%llX", v);
+        } break;
+        case FIELD_FLOAT:
+        case FIELD_DOUBLE: {
+            bool is_decimal = ok && strspn(buf, "0123456789+-.eE") == value.length;
+            double v = is_decimal ? strtod(buf, &endptr) : 0.0;
+            ok = is_decimal && *endptr == '\0' && isfinite(v);
+            if (part->type == FIELD_FLOAT) {
+                ok = ok && v <= (double) FLT_MAX && v >= (double) -FLT_MAX;
+            }
+            if (ok) {
+                hgl_sb_append_sv(sb, &value);
+                if (strpbrk(buf, ".eE") == NULL) hgl_sb_append_cstr(sb, ".0");
+                if (part->type == FIELD_FLOAT) hgl_sb_append_char(sb, 'f');
+            }
+        } break;
+        case FIELD_BOOL: {
+            if (ok && (strcasecmp(buf, "true") == 0 || strcasecmp(buf, "yes") == 0 || strcmp(buf, "1") == 0)) {
+                hgl_sb_append_cstr(sb, "true");
+            } else if (ok && (strcasecmp(buf, "false") == 0 || strcasecmp(buf, "no") == 0 || strcmp(buf, "0") == 0)) {
+                hgl_sb_append_cstr(sb, "false");
+            } else {
+                ok = false;
+            }
+        } break;
+        case FIELD_RAW:
+        case FIELD_STR: break;
+    }
+
+    GEPT_ASSERT_LINE(line, ok, "`%s` record %zu, column `"HGL_SV_FMT"`: `"HGL_SV_FMT"` is not a valid "
+                     "value for the field type\n", path, n_record, HGL_SV_ARG(part->column), HGL_SV_ARG(value));
+}
+
+/**
+ * Appends one instance of the row template `rt` to `sb`. `slots[i]` is the index into
+ * `record` of the value referenced by part `i`.
+ */
+static void append_row(HglStringView line, HglStringBuilder *sb, RowTemplate *rt, Record *record,
+                       const int *slots, const char *path, size_t n_record)
+{
+    for (int i = 0; i < rt->n_parts; i++) {
+        RowPart *part = &rt->parts[i];
+        hgl_sb_append_sv(sb, &part->literal);
+        if (part->column.length == 0) {
+            continue;
+        }
+        GEPT_ASSERT_LINE(line, slots[i] >= 0 && slots[i] < record->n_fields,
+                         "`%s` record %zu: missing field `"HGL_SV_FMT"`\n", path, n_record,
+                         HGL_SV_ARG(part->column));
+        append_typed_field(line, sb, part, record_value(record, slots[i]),
+                           record->fields[slots[i]].is_string, path, n_record);
+    }
+}
+
+/**
+ * Returns a pointer to the first occurrence of `delim`, `"`, `\r` or `\n` in [p, end),
+ * or `end`. Scans 16 bytes at a time where possible.
+ */
+static const char *csv_scan(const char *p, const char *end, char delim)
+{
+#if defined(__SSE2__)
+    const __m128i d  = _mm_set1_epi8(delim);
+    const __m128i q  = _mm_set1_epi8('"');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) p);
+        __m128i hits  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, d), _mm_cmpeq_epi8(block, q)),
+                                     _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, lf)));
+        unsigned mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != delim && *p != '"' && *p != '\r' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Reads the next CSV record (RFC 4180) starting at `*p` into `record`. Blank lines
+ * are skipped. Returns false at the end of the input.
+ */
+static bool csv_next_record(HglStringView line, const char **p, const char *end, char delim, Record *record)
+{
+    record->n_fields = 0;
+    hgl_sb_clear(&record->arena);
+
+    while (*p < end && (**p == '\n' || **p == '\r')) {
+        (*p)++;
+    }
+    if (*p >= end) {
+        return false;
+    }
+
+    while (true) {
+        const char *c = *p;
+        if (c < end && *c == '"') {
+            /* quoted field. `""` is an escaped quote */
+            const char *start = ++c;
+            bool has_escapes = false;
+            const char *q;
+            while (true) {
+                q = memchr(c, '"', end - c);
+                GEPT_ASSERT_LINE(line, q != NULL, "Unterminated quoted CSV field\n");
+                if (q + 1 < end && q[1] == '"') {
+                    has_escapes = true;
+                    c = q + 2;
+                    continue;
+                }
+                break;
+            }
+            if (has_escapes) {
+                size_t length = 0;
+                for (const char *s = start; s < q; s++) {
+                    hgl_sb_append_char(&record->arena, *s);
+                    length++;
+                    if (*s == '"') s++;
+                }
+                record_push(line, record, NULL, length, true);
+            } else {
+                record_push(line, record, start, q - start, true);
+            }
+            c = q + 1;
+        } else {
+            /* unquoted field. Stray quotes are part of the value */
+            const char *q = csv_scan(c, end, delim);
+            while (q < end && *q == '"') {
+                q = csv_scan(q + 1, end, delim);
+            }
+            record_push(line, record, c, q - c, true);
+            c = q;
+        }
+
+        if (c >= end) {
+            *p = c;
+            return true;
+        }
+        if (*c == delim) {
+            *p = c + 1;
+            if (*p >= end) {
+                record_push(line, record, *p, 0, true);
+                return true;
+            }
+            continue;
+        }
+        GEPT_ASSERT_LINE(line, *c == '\n' || *c == '\r', "Unexpected character after quoted CSV field\n");
+        *p = c + 1 + (*c == '\r' && c + 1 < end && c[1] == '\n');
+        return true;
+    }
+}
+
+/**
+ * Skips whitespace in a JSON document.
+ */
+static void json_skip_ws(const char **p, const char *end)
+{
+    while (*p < end && (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r')) {
+        (*p)++;
+    }
+}
+
+/**
+ * Skips the whitespace after the `[` or `{` of an array or object closed by `close`.
+ * Returns true if an element follows, false (with `*p` past `close`) if it is empty.
+ */
+static bool json_first_element(HglStringView line, const char **p, const char *end, char close)
+{
+    json_skip_ws(p, end);
+    GEPT_ASSERT_LINE(line, *p < end, "Unexpected end of JSON input\n");
+    if (**p == close) {
+        (*p)++;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Skips the `,` after an element of an array or object closed by `close`. Returns
+ * true if another element follows, false (with `*p` past `close`) at the end.
+ */
+static bool json_next_element(HglStringView line, const char **p, const char *end, char close)
+{
+    json_skip_ws(p, end);
+    GEPT_ASSERT_LINE(line, *p < end, "Unexpected end of JSON input\n");
+    if (**p == close) {
+        (*p)++;
+        return false;
+    }
+    GEPT_ASSERT_LINE(line, **p == ',', "Expected ',' or '%c' in JSON, got '%c'\n", close, **p);
+    (*p)++;
+    json_skip_ws(p, end);
+    GEPT_ASSERT_LINE(line, *p < end, "Unexpected end of JSON input\n");
+    GEPT_ASSERT_LINE(line, **p != close, "Trailing ',' before '%c' in JSON\n", close);
+    return true;
+}
+
+/**
+ * Appends the UTF-8 encoding of `cp` to `sb`.
+ */
+static void append_utf8(HglStringBuilder *sb, uint32_t cp)
+{
+    if (cp < 0x80) {
+        hgl_sb_append_char(sb, (char) cp);
+    } else if (cp < 0x800) {
+        hgl_sb_append_char(sb, (char) (0xC0 | (cp >> 6)));
+        hgl_sb_append_char(sb, (char) (0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        hgl_sb_append_char(sb, (char) (0xE0 | (cp >> 12)));
+        hgl_sb_append_char(sb, (char) (0x80 | ((cp >> 6) & 0x3F)));
+        hgl_sb_append_char(sb, (char) (0x80 | (cp & 0x3F)));
+    } else {
+        hgl_sb_append_char(sb, (char) (0xF0 | (cp >> 18)));
+        hgl_sb_append_char(sb, (char) (0x80 | ((cp >> 12) & 0x3F)));
+        hgl_sb_append_char(sb, (char) (0x80 | ((cp >> 6) & 0x3F)));
+        hgl_sb_append_char(sb, (char) (0x80 | (cp & 0x3F)));
+    }
+}
+
+/**
+ * Reads the 4 hex digits of a JSON `\u` escape at `c`.
+ */
+static uint32_t json_read_hex4(HglStringView line, const char *c, const char *end)
+{
+    GEPT_ASSERT_LINE(line, end - c >= 4, "Invalid \\u escape in JSON string\n");
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        GEPT_ASSERT_LINE(line, isxdigit((unsigned char) c[i]), "Invalid \\u escape in JSON string\n");
+        value = (value << 4) | (uint32_t) (isdigit((unsigned char) c[i]) ? c[i] - '0' : (c[i] | 0x20) - 'a' + 10);
+    }
+    return value;
+}
+
+/**
+ * Reads a JSON string starting at `*p` (which must point at the opening quote) and
+ * pushes it onto `record`. Strings containing escapes are unescaped into the arena.
+ */
+static void json_read_string(HglStringView line, const char **p, const char *end, Record *record)
+{
+    const char *start = ++(*p);
+    const char *c = start;
+    while (c < end && *c != '"' && *c != '\\') c++;
+    GEPT_ASSERT_LINE(line, c < end, "Unterminated JSON string\n");
+    if (*c == '"') {
+        record_push(line, record, start, c - start, true);
+        *p = c + 1;
+        return;
+    }
+
+    size_t arena_start = record->arena.length;
+    hgl_sb_append(&record->arena, start, c - start);
+    while (true) {
+        GEPT_ASSERT_LINE(line, c < end, "Unterminated JSON string\n");
+        if (*c == '"') {
+            break;
+        }
+        if (*c != '\\') {
+            hgl_sb_append_char(&record->arena, *c++);
+            continue;
+        }
+        GEPT_ASSERT_LINE(line, c + 1 < end, "Unterminated JSON string\n");
+        char e = c[1];
+        c += 2;
+        switch (e) {
+            case 'n': hgl_sb_append_char(&record->arena, '\n'); break;
+            case 't': hgl_sb_append_char(&record->arena, '\t'); break;
+            case 'r': hgl_sb_append_char(&record->arena, '\r'); break;
+            case 'b': hgl_sb_append_char(&record->arena, '\b'); break;
+            case 'f': hgl_sb_append_char(&record->arena, '\f'); break;
+            case '"': case '\\': case '/': hgl_sb_append_char(&record->arena, e); break;
+            case 'u': {
+                uint32_t cp = json_read_hex4(line, c, end);
+                c += 4;
+                /* surrogates only encode code points as high-low pairs */
+                GEPT_ASSERT_LINE(line, cp < 0xDC00 || cp > 0xDFFF, "Unpaired surrogate in JSON string\n");
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    GEPT_ASSERT_LINE(line, end - c >= 2 && c[0] == '\\' && c[1] == 'u',
+                                     "Unpaired surrogate in JSON string\n");
+                    uint32_t lo = json_read_hex4(line, c + 2, end);
+                    GEPT_ASSERT_LINE(line, lo >= 0xDC00 && lo <= 0xDFFF, "Unpaired surrogate in JSON string\n");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    c += 6;
+                }
+                append_utf8(&record->arena, cp);
+            } break;
+            default: GEPT_ASSERT_LINE(line, false, "Invalid escape `\\%c` in JSON string\n", e); break;
+        }
+    }
+    record_push(line, record, NULL, record->arena.length - arena_start, true);
+    *p = c + 1;
+}
+
+/**
+ * Skips the JSON string starting at `*p` (which must point at the opening quote),
+ * checking its escapes.
+ */
+static void json_skip_string(HglStringView line, const char **p, const char *end)
+{
+    for ((*p)++; *p < end && **p != '"'; (*p)++) {
+        if (**p != '\\') {
+            continue;
+        }
+        (*p)++;
+        GEPT_ASSERT_LINE(line, *p < end, "Unterminated JSON string\n");
+        GEPT_ASSERT_LINE(line, strchr("\"\\/bfnrtu", **p) != NULL, "Invalid escape `\\%c` in JSON string\n", **p);
+        if (**p == 'u') {
+            json_read_hex4(line, *p + 1, end);
+            *p += 4;
+        }
+    }
+    GEPT_ASSERT_LINE(line, *p < end, "Unterminated JSON string\n");
+    (*p)++;
+}
+
+/**
+ * Skips the JSON number at `*p`: `-?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?`.
+ * Returns false if there is none.
+ */
+static bool json_skip_number(const char **p, const char *end)
+{
+    const char *c = *p;
+    if (c < end && *c == '-') c++;
+    if (c < end && *c == '0') {
+        c++;
+    } else if (c < end && isdigit((unsigned char) *c)) {
+        while (c < end && isdigit((unsigned char) *c)) c++;
+    } else {
+        return false;
+    }
+    if (c < end && *c == '.') {
+        c++;
+        if (c == end || !isdigit((unsigned char) *c)) return false;
+        while (c < end && isdigit((unsigned char) *c)) c++;
+    }
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        c++;
+        if (c < end && (*c == '+' || *c == '-')) c++;
+        if (c == end || !isdigit((unsigned char) *c)) return false;
+        while (c < end && isdigit((unsigned char) *c)) c++;
+    }
+    *p = c;
+    return true;
+}
+
+/**
+ * Skips the JSON value at `*p`, which is nested `depth` levels deep, checking its
+ * syntax.
+ */
+static void json_skip_value(HglStringView line, const char **p, const char *end, int depth)
+{
+    GEPT_ASSERT_LINE(line, *p < end, "Unexpected end of JSON input\n");
+    GEPT_ASSERT_LINE(line, depth < MAX_JSON_DEPTH, "JSON is nested too deeply\n");
+
+    if (**p == '"') {
+        json_skip_string(line, p, end);
+    } else if (**p == '[') {
+        (*p)++;
+        bool has_element = json_first_element(line, p, end, ']');
+        while (has_element) {
+            json_skip_value(line, p, end, depth + 1);
+            has_element = json_next_element(line, p, end, ']');
+        }
+    } else if (**p == '{') {
+        (*p)++;
+        bool has_member = json_first_element(line, p, end, '}');
+        while (has_member) {
+            GEPT_ASSERT_LINE(line, **p == '"', "Expected a key in JSON object\n");
+            json_skip_string(line, p, end);
+            json_skip_ws(p, end);
+            GEPT_ASSERT_LINE(line, *p < end && **p == ':', "Expected ':' in JSON object\n");
+            (*p)++;
+            json_skip_ws(p, end);
+            json_skip_value(line, p, end, depth + 1);
+            has_member = json_next_element(line, p, end, '}');
+        }
+    } else {
+        static const char *const literals[] = {"true", "false", "null"};
+        for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+            size_t length = strlen(literals[i]);
+            if ((size_t) (end - *p) >= length && memcmp(*p, literals[i], length) == 0) {
+                *p += length;
+                return;
+            }
+        }
+        GEPT_ASSERT_LINE(line, json_skip_number(p, end), "Invalid JSON value\n");
+    }
+}
+
+/**
+ * Reads any JSON value starting at `*p` and pushes it onto `record`. Strings are
+ * unescaped, other values (nested objects and arrays included) are checked and
+ * pushed verbatim.
+ */
+static void json_read_value(HglStringView line, const char **p, const char *end, Record *record)
+{
+    json_skip_ws(p, end);
+    GEPT_ASSERT_LINE(line, *p < end, "Unexpected end of JSON input\n");
+
+    if (**p == '"') {
+        json_read_string(line, p, end, record);
+        return;
+    }
+
+    const char *start = *p;
+    json_skip_value(line, p, end, 1);
+    record_push(line, record, start, *p - start, false);
+}
+
+/**
+ * Expands a @csv or @json directive: `body` is instantiated once for every record of
+ * the file at `path`. CSV files are expected to have a header row unless
+ * `header(none)` is given, in which case columns are referred to by index. JSON files
+ * must be valid JSON holding an array of objects (fields referred to by key) or arrays
+ * (by index).
+ */
+static void expand_table(HglStringView line, HglStringBuilder *output, HglStringView directive,
+                         const char *path, HglStringView tokens, HglStringView body)
+{
+    bool is_json = hgl_sv_equals(directive, HGL_SV_LIT("@json"));
+    bool has_header = true;
+    char delim = ',';
+
+    Attribute attr;
+    while (parse_attribute(line, &tokens, &attr)) {
+        if (!is_json && hgl_sv_equals(attr.name, HGL_SV_LIT("delim"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args == 1 && attr.args[0].length >= 1, "Expected `delim(C)`\n");
+            delim = hgl_sv_equals(attr.args[0], HGL_SV_LIT("\\t")) ? '\t' : attr.args[0].start[0];
+        } else if (!is_json && hgl_sv_equals(attr.name, HGL_SV_LIT("header"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `header(none)` or `header(first-row)`\n");
+            has_header = !hgl_sv_equals(attr.args[0], HGL_SV_LIT("none"));
+        } else {
+            GEPT_ASSERT_LINE(line, false, "Unknown attribute `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr.name));
+        }
+    }
+
+    MappedFile *mf = mapped_file_get(path);
+    GEPT_ASSERT_LINE(line, mf != NULL, "Unable to open file `%s`\n", path);
+
+    static RowTemplate rt;
+    row_template_compile(line, body, &rt);
+
+    Record record = {.arena = hgl_sb_make(.initial_capacity = 4096)};
+    Record keys   = {.arena = hgl_sb_make(.initial_capacity = 256)};
+    int slots[MAX_ROW_FIELDS];
+    size_t n_records = 0;
+
+    /* columns referred to by index */
+    for (int i = 0; i < rt.n_parts; i++) {
+        HglStringView column = rt.parts[i].column;
+        slots[i] = (column.length > 0 && isdigit(column.start[0])) ? (int) hgl_sv_to_u64(column) : -1;
+    }
+
+    const char *p   = mf->data;
+    const char *end = mf->data + mf->size;
+
+    if (!is_json) {
+        if (has_header) {
+            GEPT_ASSERT_LINE(line, csv_next_record(line, &p, end, delim, &keys), "`%s` is empty\n", path);
+            for (int i = 0; i < rt.n_parts; i++) {
+                for (int j = 0; j < keys.n_fields && rt.parts[i].column.length > 0; j++) {
+                    if (hgl_sv_equals(rt.parts[i].column, record_value(&keys, j))) {
+                        slots[i] = j;
+                    }
+                }
+                GEPT_ASSERT_LINE(line, rt.parts[i].column.length == 0 || slots[i] >= 0,
+                                 "`%s` has no column named `"HGL_SV_FMT"`\n",
+                                 path, HGL_SV_ARG(rt.parts[i].column));
+            }
+        }
+
+        while (csv_next_record(line, &p, end, delim, &record)) {
+            append_row(line, output, &rt, &record, slots, path, ++n_records);
+        }
+    } else {
+        json_skip_ws(&p, end);
+        GEPT_ASSERT_LINE(line, p < end && *p == '[', "`%s` must contain a JSON array\n", path);
+        p++;
+        bool has_record = json_first_element(line, &p, end, ']');
+        while (has_record) {
+            n_records++;
+            record.n_fields = 0;
+            hgl_sb_clear(&record.arena);
+
+            int elem_slots[MAX_ROW_FIELDS];
+            memcpy(elem_slots, slots, sizeof(slots));
+
+            char open = *p++;
+            char close = (open == '{') ? '}' : ']';
+            GEPT_ASSERT_LINE(line, open == '{' || open == '[', "`%s` record %zu: expected an object or an array\n",
+                             path, n_records);
+            bool has_field = json_first_element(line, &p, end, close);
+            while (has_field) {
+                if (open == '{') {
+                    /* "key": value */
+                    keys.n_fields = 0;
+                    hgl_sb_clear(&keys.arena);
+                    GEPT_ASSERT_LINE(line, *p == '"', "`%s` record %zu: expected a key\n", path, n_records);
+                    json_read_string(line, &p, end, &keys);
+                    json_skip_ws(&p, end);
+                    GEPT_ASSERT_LINE(line, p < end && *p == ':', "`%s` record %zu: expected ':'\n", path, n_records);
+                    p++;
+                    HglStringView key = record_value(&keys, 0);
+                    for (int i = 0; i < rt.n_parts; i++) {
+                        if (hgl_sv_equals(rt.parts[i].column, key)) {
+                            elem_slots[i] = record.n_fields;
+                        }
+                    }
+                }
+                json_read_value(line, &p, end, &record);
+                has_field = json_next_element(line, &p, end, close);
+            }
+
+            append_row(line, output, &rt, &record, elem_slots, path, n_records);
+            has_record = json_next_element(line, &p, end, ']');
+        }
+        json_skip_ws(&p, end);
+        GEPT_ASSERT_LINE(line, p == end, "`%s`: unexpected data after the JSON array\n", path);
+    }
+
+    hgl_sb_destroy(&record.arena);
+    hgl_sb_destroy(&keys.arena);
+}
+
+/**
+ * Expands a @lut directive: generates the lookup table `generator` (one of crc8,
+ * crc16, crc32, crc32c, crc, sin, cos, gamma, popcount or bitrev) natively and appends
+ * it as a comma-separated list of values.
+ */
+static void expand_lut(HglStringView line, HglStringBuilder *output, HglStringView generator, HglStringView tokens)
+{
+    /* defaults */
+    uint64_t poly    = 0;
+    int width        = 0;
+    uint64_t size    = 256;
+    int q_int        = 1;
+    int q_frac       = 15;
+    double gamma     = 2.2;
+    bool reflect     = false;
+    bool has_poly    = false;
+    bool has_reflect = false;
+
+    Attribute attr;
+    while (parse_attribute(line, &tokens, &attr)) {
+        GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected a single argument to `"HGL_SV_FMT"`\n",
+                         HGL_SV_ARG(attr.name));
+        if (hgl_sv_equals(attr.name, HGL_SV_LIT("poly"))) {
+            poly = hgl_sv_to_u64(attr.args[0]);
+            has_poly = true;
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("width"))) {
+            width = (int) hgl_sv_to_u64(attr.args[0]);
+            GEPT_ASSERT_LINE(line, width >= 1 && width <= 64, "width(N) must be in the range [1, 64]\n");
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("size"))) {
+            size = hgl_sv_to_u64(attr.args[0]);
+            GEPT_ASSERT_LINE(line, size >= 1 && size <= (1 << 24), "size(N) must be in the range [1, 2^24]\n");
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("q"))) {
+            HglStringView q = attr.args[0];
+            q_int = (int) hgl_sv_lchop_u64(&q);
+            GEPT_ASSERT_LINE(line, hgl_sv_lchop_if_starts_with(&q, "."), "Expected `q(INT.FRAC)`, e.g. q(1.15)\n");
+            q_frac = (int) hgl_sv_lchop_u64(&q);
+            GEPT_ASSERT_LINE(line, q_int >= 1 && q_int + q_frac <= 64, "Invalid fixed-point format\n");
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("gamma"))) {
+            gamma = hgl_sv_to_f64(attr.args[0]);
+            GEPT_ASSERT_LINE(line, gamma > 0.0, "gamma(G) must be positive\n");
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("reflect"))) {
+            reflect = hgl_sv_to_u64(attr.args[0]) != 0;
+            has_reflect = true;
+        } else {
+            GEPT_ASSERT_LINE(line, false, "Unknown attribute `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr.name));
+        }
+    }
+
+    uint64_t *values = NULL;
+    bool is_signed = false;
+    bool is_hex    = false;
+
+    if (hgl_sv_equals(generator, HGL_SV_LIT("crc8"))   ||
+        hgl_sv_equals(generator, HGL_SV_LIT("crc16"))  ||
+        hgl_sv_equals(generator, HGL_SV_LIT("crc32"))  ||
+        hgl_sv_equals(generator, HGL_SV_LIT("crc32c")) ||
+        hgl_sv_equals(generator, HGL_SV_LIT("crc"))) {
+        /* CRC tables (byte-wise, 256 entries) */
+        if (hgl_sv_equals(generator, HGL_SV_LIT("crc8"))) {
+            width = 8;  if (!has_poly) poly = 0x07;
+        } else if (hgl_sv_equals(generator, HGL_SV_LIT("crc16"))) {
+            width = 16; if (!has_poly) poly = 0x1021;
+        } else if (hgl_sv_equals(generator, HGL_SV_LIT("crc32"))) {
+            width = 32; if (!has_poly) poly = 0x04C11DB7; if (!has_reflect) reflect = true;
+        } else if (hgl_sv_equals(generator, HGL_SV_LIT("crc32c"))) {
+            width = 32; if (!has_poly) poly = 0x1EDC6F41; if (!has_reflect) reflect = true;
+        } else {
+            GEPT_ASSERT_LINE(line, has_poly && width >= 8, "`@lut crc` requires poly(P) and width(N >= 8)\n");
+        }
+
+        size = 256;
+        is_hex = true;
+        uint64_t mask = (width == 64) ? UINT64_MAX : (1ULL << width) - 1;
+        uint64_t top  = 1ULL << (width - 1);
+
+        /* `poly` is in normal form. Reflected tables shift right, with the bit-reversed polynomial */
+        if (reflect) {
+            uint64_t reversed = 0;
+            for (int k = 0; k < width; k++) {
+                reversed |= ((poly >> k) & 1) << (width - 1 - k);
+            }
+            poly = reversed;
+        }
+        values = malloc(size * sizeof(uint64_t));
+        for (uint64_t i = 0; i < 256; i++) {
+            uint64_t c;
+            if (reflect) {
+                c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ poly : (c >> 1);
+            } else {
+                c = i << (width - 8);
+                for (int k = 0; k < 8; k++) c = (c & top) ? (c << 1) ^ poly : (c << 1);
+            }
+            values[i] = c & mask;
+        }
+    } else if (hgl_sv_equals(generator, HGL_SV_LIT("sin")) ||
+               hgl_sv_equals(generator, HGL_SV_LIT("cos"))) {
+        /* one full period of sin/cos in signed fixed-point Q(q_int).(q_frac) */
+        bool is_cos = hgl_sv_equals(generator, HGL_SV_LIT("cos"));
+        width = q_int + q_frac;
+        is_signed = true;
+        double scale = ldexp(1.0, q_frac);
+        int64_t max = (width == 64) ? INT64_MAX : (int64_t) ((1ULL << (width - 1)) - 1);
+        int64_t min = -max - 1;
+        values = malloc(size * sizeof(uint64_t));
+        for (uint64_t i = 0; i < size; i++) {
+            double angle = 2.0 * M_PI * (double) i / (double) size;
+            double v = round((is_cos ? cos(angle) : sin(angle)) * scale);
+            int64_t fixed = (v >= (double) max) ? max : (v <= (double) min) ? min : (int64_t) v;
+            values[i] = (uint64_t) fixed;
+        }
+    } else if (hgl_sv_equals(generator, HGL_SV_LIT("gamma"))) {
+        /* gamma curve mapping [0, size) onto [0, 2^width - 1] */
+        if (width == 0) width = 8;
+        GEPT_ASSERT_LINE(line, width <= 32, "width(N) must be at most 32 for gamma tables\n");
+        double max = (double) ((1ULL << width) - 1);
+        values = malloc(size * sizeof(uint64_t));
+        for (uint64_t i = 0; i < size; i++) {
+            double x = (size > 1) ? (double) i / (double) (size - 1) : 0.0;
+            values[i] = (uint64_t) round(pow(x, gamma) * max);
+        }
+    } else if (hgl_sv_equals(generator, HGL_SV_LIT("popcount"))) {
+        values = malloc(size * sizeof(uint64_t));
+        for (uint64_t i = 0; i < size; i++) {
+            values[i] = (uint64_t) __builtin_popcountll(i);
+        }
+    } else if (hgl_sv_equals(generator, HGL_SV_LIT("bitrev"))) {
+        /* reverses the lowest `width` bits of every index */
+        if (width == 0) width = 8;
+        GEPT_ASSERT_LINE(line, width <= 24, "width(N) must be at most 24 for bitrev tables\n");
+        size = 1ULL << width;
+        is_hex = true;
+        values = malloc(size * sizeof(uint64_t));
+        for (uint64_t i = 0; i < size; i++) {
+            uint64_t r = 0;
+            for (int k = 0; k < width; k++) r |= ((i >> k) & 1) << (width - 1 - k);
+            values[i] = r;
+        }
+    } else {
+        GEPT_ASSERT_LINE(line, false, "Unknown @lut generator `"HGL_SV_FMT"`\n", HGL_SV_ARG(generator));
+    }
+
+    /* append table, 8 values per row */
+    int hex_digits = (width + 3) / 4;
+    for (uint64_t i = 0; i < size; i++) {
+        if (i % 8 == 0) {
+            hgl_sb_append_cstr(output, (i == 0) ? "    " : ",\n    ");
+        } else {
+            hgl_sb_append_cstr(output, ", ");
+        }
+        if (is_hex) {
+            hgl_sb_append_fmt(output, "0x%0*llX", hex_digits, (unsigned long long) values[i]);
+        } else if (is_signed) {
+            hgl_sb_append_fmt(output, "%lld", (long long) (int64_t) values[i]);
+        } else {
+            hgl_sb_append_fmt(output, "%llu", (unsigned long long) values[i]);
+        }
+    }
+    hgl_sb_append_char(output, '\n');
+
+    free(values);
+}
+
+/**
+ * Updates the CRC-32 (as used by gzip) `crc` with `size` bytes of `data`.
+ */
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * Builds the canonical Huffman code `h` from the code lengths of its `n` symbols.
+ * Returns false if the lengths over-subscribe the code. Incomplete codes are
+ * allowed, since deflate uses them for blocks with a single distance code.
+ */
+static bool inflate_build(InflateHuffman *h, const uint8_t *lengths, int n)
+{
+    memset(h->counts, 0, sizeof(h->counts));
+    for (int i = 0; i < n; i++) {
+        h->counts[lengths[i]]++;
+    }
+    int left = 1;
+    for (int length = 1; length <= 15; length++) {
+        left = (left << 1) - h->counts[length];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t offsets[16] = {0};
+    for (int length = 1; length < 15; length++) {
+        offsets[length + 1] = offsets[length] + h->counts[length];
+    }
+    for (int i = 0; i < n; i++) {
+        if (lengths[i] != 0) {
+            h->symbols[offsets[lengths[i]]++] = (uint16_t) i;
+        }
+    }
+
+    /* codes are read starting from their most significant bit, so the table is indexed bit-reversed */
+    memset(h->fast, 0, sizeof(h->fast));
+    uint32_t code  = 0;
+    int index = 0;
+    for (int length = 1; length <= INFLATE_FAST_BITS; length++) {
+        for (int i = 0; i < h->counts[length]; i++, index++, code++) {
+            uint32_t reversed = 0;
+            for (int b = 0; b < length; b++) {
+                reversed |= ((code >> b) & 1) << (length - 1 - b);
+            }
+            for (uint32_t k = reversed; k < (1u << INFLATE_FAST_BITS); k += 1u << length) {
+                h->fast[k] = (uint16_t) (length << 9 | h->symbols[index]);
+            }
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+/**
+ * Fills the bit buffer of `z` with whole bytes of input.
+ */
+static void inflate_refill(Inflater *z)
+{
+    while (z->n_bits <= 56 && z->in_pos < z->in_size) {
+        z->bits |= (uint64_t) z->in[z->in_pos++] << z->n_bits;
+        z->n_bits += 8;
+    }
+}
+
+/**
+ * Reads the next `n` (at most 16) bits of input.
+ */
+static uint32_t inflate_bits(Inflater *z, int n)
+{
+    if (z->n_bits < n) {
+        inflate_refill(z);
+    }
+    GEPT_ASSERT_LINE(z->line, z->n_bits >= n, "`%s` is truncated\n", z->path);
+    uint32_t value = (uint32_t) (z->bits & ((1ull << n) - 1));
+    z->bits >>= n;
+    z->n_bits -= n;
+    return value;
+}
+
+/**
+ * Skips to the next byte boundary of the input, and returns the whole bytes held
+ * in the bit buffer to the input, so it can be read byte-wise.
+ */
+static void inflate_align(Inflater *z)
+{
+    inflate_bits(z, z->n_bits % 8);
+    z->in_pos -= z->n_bits / 8;
+    z->bits    = 0;
+    z->n_bits  = 0;
+}
+
+/**
+ * Decodes the next symbol of the code `h`. Codes up to INFLATE_FAST_BITS long are
+ * looked up in one step, longer ones (and codes at the very end of the input) are
+ * decoded bit by bit.
+ */
+static int inflate_symbol(Inflater *z, const InflateHuffman *h)
+{
+    if (z->n_bits < 15) {
+        inflate_refill(z);
+    }
+    uint32_t entry = h->fast[z->bits & ((1u << INFLATE_FAST_BITS) - 1)];
+    if (entry != 0 && (int) (entry >> 9) <= z->n_bits) {
+        z->bits >>= entry >> 9;
+        z->n_bits -= entry >> 9;
+        return entry & 0x1FF;
+    }
+
+    int code  = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= 15; length++) {
+        code |= (int) inflate_bits(z, 1);
+        int count = h->counts[length];
+        if (code - first < count) {
+            return h->symbols[index + code - first];
+        }
+        index += count;
+        first  = (first + count) << 1;
+        code <<= 1;
+    }
+    GEPT_ASSERT_LINE(z->line, false, "`%s` is corrupt: invalid Huffman code\n", z->path);
+    return -1;
+}
+
+/**
+ * Reads the header of the next deflate block, including its Huffman codes.
+ */
+static void inflate_block_begin(Inflater *z)
+{
+    z->is_final_block = inflate_bits(z, 1);
+    z->block_type     = (int) inflate_bits(z, 2);
+
+    uint8_t lengths[286 + 30] = {0};
+    int n_lit  = 288;
+    int n_dist = 30;
+    if (z->block_type == 0) {
+        inflate_align(z);
+        GEPT_ASSERT_LINE(z->line, z->in_size - z->in_pos >= 4, "`%s` is truncated\n", z->path);
+        const uint8_t *p = z->in + z->in_pos;
+        uint32_t length = p[0] | (uint32_t) p[1] << 8;
+        GEPT_ASSERT_LINE(z->line, length == (~(p[2] | (uint32_t) p[3] << 8) & 0xFFFF),
+                         "`%s` is corrupt: invalid stored block\n", z->path);
+        z->in_pos     += 4;
+        z->stored_left = length;
+        return;
+    } else if (z->block_type == 1) {
+        /* fixed codes */
+        uint8_t fixed[288];
+        memset(fixed, 8, 144);
+        memset(fixed + 144, 9, 112);
+        memset(fixed + 256, 7, 24);
+        memset(fixed + 280, 8, 8);
+        inflate_build(&z->lit, fixed, 288);
+        memset(fixed, 5, 30);
+        inflate_build(&z->dist, fixed, 30);
+        return;
+    }
+    GEPT_ASSERT_LINE(z->line, z->block_type == 2, "`%s` is corrupt: invalid block type\n", z->path);
+
+    /* dynamic codes: the code lengths are themselves Huffman coded */
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    n_lit  = (int) inflate_bits(z, 5) + 257;
+    n_dist = (int) inflate_bits(z, 5) + 1;
+    int n_code_lengths = (int) inflate_bits(z, 4) + 4;
+    GEPT_ASSERT_LINE(z->line, n_lit <= 286 && n_dist <= 30, "`%s` is corrupt: too many codes\n", z->path);
+    uint8_t code_lengths[19] = {0};
+    for (int i = 0; i < n_code_lengths; i++) {
+        code_lengths[order[i]] = (uint8_t) inflate_bits(z, 3);
+    }
+    InflateHuffman code_length_code;
+    GEPT_ASSERT_LINE(z->line, inflate_build(&code_length_code, code_lengths, 19),
+                     "`%s` is corrupt: invalid code lengths\n", z->path);
+
+    int i = 0;
+    while (i < n_lit + n_dist) {
+        int symbol = inflate_symbol(z, &code_length_code);
+        if (symbol < 16) {
+            lengths[i++] = (uint8_t) symbol;
+            continue;
+        }
+        uint8_t value = 0;
+        int repeat;
+        if (symbol == 16) {
+            GEPT_ASSERT_LINE(z->line, i > 0, "`%s` is corrupt: repeat without a length\n", z->path);
+            value  = lengths[i - 1];
+            repeat = 3 + (int) inflate_bits(z, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + (int) inflate_bits(z, 3);
+        } else {
+            repeat = 11 + (int) inflate_bits(z, 7);
+        }
+        GEPT_ASSERT_LINE(z->line, i + repeat <= n_lit + n_dist, "`%s` is corrupt: too many lengths\n", z->path);
+        while (repeat-- > 0) {
+            lengths[i++] = value;
+        }
+    }
+    GEPT_ASSERT_LINE(z->line, lengths[256] != 0 && inflate_build(&z->lit, lengths, n_lit) &&
+                     inflate_build(&z->dist, lengths + n_lit, n_dist),
+                     "`%s` is corrupt: invalid Huffman codes\n", z->path);
+}
+
+/**
+ * Reads the header of the next gzip member.
+ */
+static void inflate_member_begin(Inflater *z)
+{
+    const uint8_t *p = z->in + z->in_pos;
+    size_t left = z->in_size - z->in_pos;
+    GEPT_ASSERT_LINE(z->line, left >= 10 && p[0] == 0x1F && p[1] == 0x8B, "`%s` is not a gzip file\n", z->path);
+    GEPT_ASSERT_LINE(z->line, p[2] == 8, "`%s` uses an unknown compression method\n", z->path);
+
+    /* skip the optional extra field, file name, comment and header CRC */
+    uint8_t flags = p[3];
+    size_t i = 10;
+    if ((flags & 0x04) && i + 2 <= left) {
+        i += 2 + (p[i] | (size_t) p[i + 1] << 8);
+    }
+    for (uint8_t flag = 0x08; flag <= 0x10; flag <<= 1) {
+        if (flags & flag) {
+            while (i < left && p[i] != 0) {
+                i++;
+            }
+            i++;
+        }
+    }
+    if (flags & 0x02) {
+        i += 2;
+    }
+    GEPT_ASSERT_LINE(z->line, i <= left, "`%s` is truncated\n", z->path);
+
+    z->in_pos        += i;
+    z->block_type     = -1;
+    z->is_final_block = false;
+    z->crc            = 0;
+    z->n_out          = 0;
+}
+
+/**
+ * Checks the trailer of the current gzip member, and starts the next member if
+ * there is one.
+ */
+static void inflate_member_end(Inflater *z)
+{
+    z->crc = crc32_update(z->crc, z->buf + z->crc_pos, z->pos - z->crc_pos);
+    z->crc_pos = z->pos;
+
+    inflate_align(z);
+    GEPT_ASSERT_LINE(z->line, z->in_size - z->in_pos >= 8, "`%s` is truncated\n", z->path);
+    const uint8_t *p = z->in + z->in_pos;
+    uint32_t crc  = p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+    uint32_t size = p[4] | (uint32_t) p[5] << 8 | (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+    GEPT_ASSERT_LINE(z->line, crc == z->crc && size == (uint32_t) z->n_out,
+                     "`%s` is corrupt: CRC or size mismatch\n", z->path);
+    z->in_pos += 8;
+
+    /* concatenated gzip files are a valid gzip file. Anything else following is ignored, like gzip does */
+    if (z->in_size - z->in_pos >= 2 && z->in[z->in_pos] == 0x1F && z->in[z->in_pos + 1] == 0x8B) {
+        inflate_member_begin(z);
+    } else {
+        z->done = true;
+    }
+}
+
+/**
+ * Starts decompressing the gzip file `mf`, for the directive at `line`.
+ */
+static void inflate_init(Inflater *z, HglStringView line, const MappedFile *mf)
+{
+    *z = (Inflater) {
+        .line    = line,
+        .path    = mf->path,
+        .in      = (const uint8_t *) mf->data,
+        .in_size = mf->size,
+        .buf     = malloc(INFLATE_WINDOW_SIZE + INFLATE_CHUNK_SIZE),
+        .pos     = INFLATE_WINDOW_SIZE,
+        .crc_pos = INFLATE_WINDOW_SIZE,
+    };
+    inflate_member_begin(z);
+}
+
+/**
+ * Decompresses the next chunk of at most INFLATE_CHUNK_SIZE bytes (only the last
+ * chunk is shorter) into `chunk` and `size`. Returns false once all of the file has
+ * been decompressed.
+ */
+static bool inflate_next(Inflater *z, const uint8_t **chunk, size_t *size)
+{
+    const size_t end = INFLATE_WINDOW_SIZE + INFLATE_CHUNK_SIZE;
+    if (z->pos == end) {
+        /* keep the window matches may refer to */
+        memmove(z->buf, z->buf + INFLATE_CHUNK_SIZE, INFLATE_WINDOW_SIZE);
+        z->pos     = INFLATE_WINDOW_SIZE;
+        z->crc_pos = INFLATE_WINDOW_SIZE;
+    }
+
+    static const uint16_t length_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+    };
+    static const uint8_t length_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+    };
+    static const uint16_t distance_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+        4097, 6145, 8193, 12289, 16385, 24577,
+    };
+    static const uint8_t distance_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+    };
+
+    size_t start = z->pos;
+    while (z->pos < end && !z->done) {
+        if (z->copy_length > 0) {
+            /* matches may overlap their own output, so copy byte by byte */
+            size_t n = (z->copy_length < end - z->pos) ? z->copy_length : end - z->pos;
+            uint8_t *dst = z->buf + z->pos;
+            const uint8_t *src = dst - z->copy_distance;
+            for (size_t i = 0; i < n; i++) {
+                dst[i] = src[i];
+            }
+            z->pos         += n;
+            z->n_out       += n;
+            z->copy_length -= n;
+        } else if (z->block_type == -1) {
+            if (z->is_final_block) {
+                inflate_member_end(z);
+            } else {
+                inflate_block_begin(z);
+            }
+        } else if (z->block_type == 0) {
+            size_t n = (z->stored_left < end - z->pos) ? z->stored_left : end - z->pos;
+            GEPT_ASSERT_LINE(z->line, z->in_size - z->in_pos >= n, "`%s` is truncated\n", z->path);
+            memcpy(z->buf + z->pos, z->in + z->in_pos, n);
+            z->in_pos      += n;
+            z->pos         += n;
+            z->n_out       += n;
+            z->stored_left -= n;
+            z->block_type   = (z->stored_left == 0) ? -1 : 0;
+        } else {
+            int symbol = inflate_symbol(z, &z->lit);
+            if (symbol < 256) {
+                z->buf[z->pos++] = (uint8_t) symbol;
+                z->n_out++;
+            } else if (symbol == 256) {
+                z->block_type = -1;
+            } else {
+                symbol -= 257;
+                GEPT_ASSERT_LINE(z->line, symbol < 29, "`%s` is corrupt: invalid length\n", z->path);
+                z->copy_length = length_base[symbol] + inflate_bits(z, length_extra[symbol]);
+                symbol = inflate_symbol(z, &z->dist);
+                GEPT_ASSERT_LINE(z->line, symbol < 30, "`%s` is corrupt: invalid distance\n", z->path);
+                z->copy_distance = distance_base[symbol] + inflate_bits(z, distance_extra[symbol]);
+                GEPT_ASSERT_LINE(z->line, z->copy_distance <= z->n_out,
+                                 "`%s` is corrupt: distance too far back\n", z->path);
+            }
+        }
+    }
+
+    z->crc = crc32_update(z->crc, z->buf + z->crc_pos, z->pos - z->crc_pos);
+    z->crc_pos = z->pos;
+    *chunk = z->buf + start;
+    *size  = z->pos - start;
+    return *size > 0;
+}
+
+/**
+ * Formats every byte value with `--embed-fmt` and `--embed-delim` into `embed_table`,
+ * unless that has been done already.
+ */
+static void embed_table_init(void)
+{
+    if (embed_table.cstr != NULL) {
+        return;
+    }
+    embed_table = hgl_sb_make(.initial_capacity = 4096);
+    for (int i = 0; i < 256; i++) {
+        embed_table_offsets[i] = (uint32_t) embed_table.length;
+        hgl_sb_append_fmt(&embed_table, *opt_embed_fmt, i);
+        hgl_sb_append_cstr(&embed_table, *opt_embed_delim);
+    }
+    embed_table_offsets[256] = (uint32_t) embed_table.length;
+}
+
+/**
+ * Appends `size` bytes of `data` to `sb` as rows of 20 bytes, each formatted with
+ * `--embed-fmt` and separated by `--embed-delim`. The formatted text of every byte
+ * value is computed once, so embedding is a sequence of copies. Every row ends with
+ * a delimiter, so data may be appended in chunks of whole rows; `append_embed_end`
+ * removes the last one.
+ */
+static void append_embed_rows(HglStringBuilder *sb, const uint8_t *data, size_t size)
+{
+    embed_table_init();
+
+    size_t max_entry_length = 0;
+    for (int i = 0; i < 256; i++) {
+        size_t n = embed_table_offsets[i + 1] - embed_table_offsets[i];
+        max_entry_length = (n > max_entry_length) ? n : max_entry_length;
+    }
+
+    if (size == 0) {
+        return;
+    }
+
+    const size_t n_bytes_per_row = 20;
+    const size_t n_rows = (size + n_bytes_per_row - 1) / n_bytes_per_row;
+    hgl_sb_grow_by_policy(sb, sb->length + size * max_entry_length + n_rows * 5 + 2,
+                          HGL_SB_DEFAULT_GROWTH_POLICY);
+
+    char *dst = sb->cstr + sb->length;
+    for (size_t row = 0; row < n_rows; row++) {
+        memcpy(dst, "    ", 4);
+        dst += 4;
+        size_t end = (row + 1) * n_bytes_per_row;
+        end = (end < size) ? end : size;
+        for (size_t i = row * n_bytes_per_row; i < end; i++) {
+            uint32_t offset = embed_table_offsets[data[i]];
+            uint32_t length = embed_table_offsets[data[i] + 1] - offset;
+            memcpy(dst, embed_table.cstr + offset, length);
+            dst += length;
+        }
+        *dst++ = '\n';
+    }
+    sb->length = dst - sb->cstr;
+}
+
+/**
+ * Removes the delimiter (typically `,`) ending the last row appended by
+ * `append_embed_rows`.
+ */
+static void append_embed_end(HglStringBuilder *sb)
+{
+    sb->length -= 1 + strlen(*opt_embed_delim);
+    sb->cstr[sb->length++] = '\n';
+    sb->cstr[sb->length] = '\0';
+}
+
+/**
+ * Appends `size` bytes of `data` to `sb`, like `append_embed_rows` followed by
+ * `append_embed_end`.
+ */
+static void append_embed(HglStringBuilder *sb, const uint8_t *data, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    append_embed_rows(sb, data, size);
+    append_embed_end(sb);
+}
+
+/**
+ * Embeds `size` bytes of `data` at the site of `line`: inline as a list of 8-bit
+ * unsigned integers, or, with `extern_name`, as declarations of an array and its
+ * length whose definitions are appended to the companion source file
+ * (`source_path` or `--embed-source`).
+ */
+static void append_embed_site(HglStringView line, HglStringBuilder *out, const uint8_t *data, size_t size,
+                              HglStringView extern_name, HglStringView source_path)
+{
+    /* inline: generate embedding as a list of 8-bit unsigned integers */
+    if (extern_name.length == 0) {
+        GEPT_ASSERT_LINE(line, source_path.length == 0, "source(PATH) requires extern(NAME)\n");
+        append_embed(out, data, size);
+        return;
+    }
+
+    /*
+     * extern: declare the array at the site and define it in the companion source
+     * file, so the data is compiled once no matter how many files include the site.
+     */
+    GEPT_ASSERT_LINE(line, size > 0, "Cannot declare an empty array for `"HGL_SV_FMT"`\n", HGL_SV_ARG(extern_name));
+    if (source_path.length == 0 && *opt_embed_source != NULL) {
+        source_path = hgl_sv_from_cstr(*opt_embed_source);
+    }
+    GEPT_ASSERT_LINE(line, source_path.length > 0,
+                     "extern(NAME) requires source(PATH) or the --embed-source option\n");
+    /* `scratch_buf` may hold the data, so the path is copied elsewhere */
+    char source_cpath[4096];
+    GEPT_ASSERT_LINE(line, source_path.length < sizeof(source_cpath), "Path is too long");
+    memcpy(source_cpath, source_path.start, source_path.length);
+    source_cpath[source_path.length] = '\0';
+    OutputSink *source = output_sink_get(source_cpath);
+
+    /* a second definition would only fail once the companion source is compiled */
+    for (size_t i = 0; i < source->n_extern_names; i++) {
+        GEPT_ASSERT_LINE(line, !hgl_sv_equals(extern_name, hgl_sv_from_cstr(source->extern_names[i])),
+                         "`"HGL_SV_FMT"` is already defined in `%s`\n", HGL_SV_ARG(extern_name), source->path);
+    }
+    source->extern_names = realloc(source->extern_names, (source->n_extern_names + 1) * sizeof(char *));
+    source->extern_names[source->n_extern_names++] = strndup(extern_name.start, extern_name.length);
+
+    hgl_sb_append_fmt(out, "extern const unsigned char "HGL_SV_FMT"[%zu];\n",
+                      HGL_SV_ARG(extern_name), size);
+    hgl_sb_append_fmt(out, "extern const size_t "HGL_SV_FMT"_len;\n", HGL_SV_ARG(extern_name));
+
+    if (source->sb.length == 0) {
+        hgl_sb_append_cstr(&source->sb, "#include <stddef.h>\n\n");
+    }
+    hgl_sb_append_fmt(&source->sb, "const unsigned char "HGL_SV_FMT"[%zu] = {\n",
+                      HGL_SV_ARG(extern_name), size);
+    append_embed(&source->sb, data, size);
+    hgl_sb_append_fmt(&source->sb, "};\nconst size_t "HGL_SV_FMT"_len = %zu;\n\n",
+                      HGL_SV_ARG(extern_name), size);
+}
+
+/**
+ * Appends up to `limit` bytes of the decompressed gzip file `mf` to `sb`, with
+ * `--embed-fmt` and `--embed-delim` if `embed` is set. Chunks are appended as they
+ * are decompressed, so the decompressed file is never held in memory as a whole.
+ */
+static void append_gunzip(HglStringView line, HglStringBuilder *sb, const MappedFile *mf, size_t limit, bool embed)
+{
+    Inflater z;
+    inflate_init(&z, line, mf);
+    const uint8_t *chunk;
+    size_t size;
+    size_t total = 0;
+    while (total < limit && inflate_next(&z, &chunk, &size)) {
+        size = (size < limit - total) ? size : limit - total;
+        if (embed) {
+            append_embed_rows(sb, chunk, size);
+        } else {
+            hgl_sb_append(sb, (const char *) chunk, size);
+        }
+        total += size;
+    }
+    if (embed && total > 0) {
+        append_embed_end(sb);
+    }
+    free(z.buf);
+}
+
+/**
+ * Parses the `decompress(FORMAT)` attribute `attr`. Only gzip is supported.
+ */
+static void parse_decompress(HglStringView line, const Attribute *attr)
+{
+    GEPT_ASSERT_LINE(line, attr->n_args == 1, "Expected `decompress(gzip)`\n");
+    GEPT_ASSERT_LINE(line, hgl_sv_equals(attr->args[0], HGL_SV_LIT("gzip")),
+                     "Unsupported compression `"HGL_SV_FMT"`. Only gzip is built in\n", HGL_SV_ARG(attr->args[0]));
+}
+
+/**
+ * Embeds `size` bytes of `data` at the site of `line` as the array `name`, which is
+ * defined in every translation unit but merged by the linker. The array is named
+ * after a hash of its contents and emitted as a COMDAT group on ELF, a selectany
+ * definition with MSVC and a weak definition elsewhere (Mach-O linkers coalesce
+ * weak definitions). Both are declared extern where C++ needs it, since const
+ * implies internal linkage in C++. Identical data embedded by any number of sources, under any
+ * name, ends up in the binary once. `name_len` is a macro holding the size.
+ */
+static void append_embed_shared(HglStringView line, HglStringBuilder *out, const uint8_t *data, size_t size,
+                                HglStringView name)
+{
+    GEPT_ASSERT_LINE(line, size > 0, "Cannot declare an empty array for `"HGL_SV_FMT"`\n", HGL_SV_ARG(name));
+    uint8_t digest[32];
+    hgl_hash_sha256(data, size, digest);
+    char hash[33];
+    for (int i = 0; i < 16; i++) {
+        snprintf(&hash[2 * i], 3, "%02x", digest[i]);
+    }
+
+    /* the data is a macro, so the assembler and the compiler can both be given it */
+    hgl_sb_append_fmt(out, "#ifndef GEPT_BLOB_%s\n#define GEPT_BLOB_%s\n", hash, hash);
+    hgl_sb_append_fmt(out, "#define GEPT_BLOB_%s_DATA \\\n", hash);
+    static const char hex_digits[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < size; i++) {
+        char entry[6] = {'0', 'x', hex_digits[data[i] >> 4], hex_digits[data[i] & 0xF], ',', ' '};
+        bool is_last  = (i + 1 == size);
+        bool ends_row = is_last || (i % 20 == 19);
+        if (i % 20 == 0) {
+            hgl_sb_append_cstr(out, "    ");
+        }
+        hgl_sb_append(out, entry, is_last ? 4 : ends_row ? 5 : 6);
+        if (ends_row) {
+            hgl_sb_append_cstr(out, is_last ? "\n" : " \\\n");
+        }
+    }
+
+    hgl_sb_append_fmt(out,
+        "#if defined(__ELF__)\n"
+        "#ifndef GEPT_STRINGIFY\n"
+        "#define GEPT_STRINGIFY_(...) #__VA_ARGS__\n"
+        "#define GEPT_STRINGIFY(...) GEPT_STRINGIFY_(__VA_ARGS__)\n"
+        "#endif\n"
+        "__asm__(\".pushsection .rodata.gept_blob_%s,\\\"aG\\\",%%progbits,gept_blob_%s,comdat\\n\"\n"
+        "        \".weak gept_blob_%s\\n\"\n"
+        "        \".type gept_blob_%s, %%object\\n\"\n"
+        "        \".size gept_blob_%s, %zu\\n\"\n"
+        "        \".balign 16\\n\"\n"
+        "        \"gept_blob_%s:\\n\"\n"
+        "        \".byte \" GEPT_STRINGIFY(GEPT_BLOB_%s_DATA) \"\\n\"\n"
+        "        \".popsection\\n\");\n"
+        "extern const unsigned char gept_blob_%s[%zu];\n"
+        "#elif defined(_MSC_VER)\n"
+        "extern __declspec(selectany) const unsigned char gept_blob_%s[%zu] = {GEPT_BLOB_%s_DATA};\n"
+        "#else\n"
+        "#ifdef __cplusplus\n"
+        "extern\n"
+        "#endif\n"
+        "__attribute__((weak)) const unsigned char gept_blob_%s[%zu] = {GEPT_BLOB_%s_DATA};\n"
+        "#endif\n"
+        "#endif\n",
+        hash, hash, hash, hash, hash, size, hash, hash, hash, size, hash, size, hash, hash, size, hash);
+    hgl_sb_append_fmt(out, "#define "HGL_SV_FMT" gept_blob_%s\n", HGL_SV_ARG(name), hash);
+    hgl_sb_append_fmt(out, "#define "HGL_SV_FMT"_len ((size_t) %zu)\n", HGL_SV_ARG(name), size);
+}
+
+/**
+ * SplitMix64, used to expand a seed into xoshiro256** states.
+ */
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+#if defined(__SSE2__)
+/**
+ * Advances two xoshiro256** generators, held in the 64-bit halves of `s[0..3]`,
+ * and returns their outputs.
+ */
+static inline __m128i xoshiro_next_x2(__m128i s[4])
+{
+    /* `* 5` and `* 9` as shifts and adds, as SSE2 has no 64-bit multiply */
+    __m128i x = _mm_add_epi64(_mm_slli_epi64(s[1], 2), s[1]);
+    x = _mm_or_si128(_mm_slli_epi64(x, 7), _mm_srli_epi64(x, 57));
+    __m128i out = _mm_add_epi64(_mm_slli_epi64(x, 3), x);
+
+    __m128i t = _mm_slli_epi64(s[1], 17);
+    s[2] = _mm_xor_si128(s[2], s[0]);
+    s[3] = _mm_xor_si128(s[3], s[1]);
+    s[1] = _mm_xor_si128(s[1], s[2]);
+    s[0] = _mm_xor_si128(s[0], s[3]);
+    s[2] = _mm_xor_si128(s[2], t);
+    s[3] = _mm_or_si128(_mm_slli_epi64(s[3], 45), _mm_srli_epi64(s[3], 19));
+    return out;
+}
+#endif
+
+/**
+ * Fills `data` with `size` pseudo-random bytes derived from `seed`. Four
+ * xoshiro256** generators, seeded with consecutive SplitMix64 outputs, run side by
+ * side (two per SSE2 register), and their outputs are interleaved as
+ * little-endian 64-bit words. The stream only depends on `seed` and is the same on
+ * every platform.
+ */
+static void random_fill(uint8_t *data, size_t size, uint64_t seed)
+{
+    enum { N_LANES = 4 };
+    uint64_t s[N_LANES][4];
+    for (int k = 0; k < N_LANES; k++) {
+        for (int j = 0; j < 4; j++) {
+            s[k][j] = splitmix64(&seed);
+        }
+    }
+
+    uint64_t out[N_LANES];
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i lo[4], hi[4]; /* lanes 0 and 1, lanes 2 and 3 */
+    for (int j = 0; j < 4; j++) {
+        lo[j] = _mm_set_epi64x((long long) s[1][j], (long long) s[0][j]);
+        hi[j] = _mm_set_epi64x((long long) s[3][j], (long long) s[2][j]);
+    }
+    for (; i + sizeof(out) <= size; i += sizeof(out)) {
+        _mm_storeu_si128((__m128i *) (data + i), xoshiro_next_x2(lo));
+        _mm_storeu_si128((__m128i *) (data + i + 16), xoshiro_next_x2(hi));
+    }
+    if (i < size) {
+        _mm_storeu_si128((__m128i *) out, xoshiro_next_x2(lo));
+        _mm_storeu_si128((__m128i *) (out + 2), xoshiro_next_x2(hi));
+        memcpy(data + i, out, size - i);
+    }
+#else
+    while (i < size) {
+        for (int k = 0; k < N_LANES; k++) {
+            uint64_t *st = s[k];
+            uint64_t x = st[1] * 5;
+            out[k] = ((x << 7) | (x >> 57)) * 9;
+
+            uint64_t t = st[1] << 17;
+            st[2] ^= st[0];
+            st[3] ^= st[1];
+            st[1] ^= st[2];
+            st[0] ^= st[3];
+            st[2] ^= t;
+            st[3] = (st[3] << 45) | (st[3] >> 19);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            out[k] = __builtin_bswap64(out[k]);
+#endif
+        }
+        size_t n = (size - i < sizeof(out)) ? size - i : sizeof(out);
+        memcpy(data + i, out, n);
+        i += n;
+    }
+#endif
+}
+
+/**
+ * Expands a @random directive: embeds `bytes(N)` pseudo-random bytes generated from
+ * `seed(S)` (default 0), distributed according to `dist(uniform)` (default),
+ * `dist(range, LO, HI)`, `dist(ascii)` (printable characters) or
+ * `dist(normal, MEAN, STDDEV)` (rounded and clamped to [0, 255]). Supports
+ * `extern(NAME)` and `source(PATH)` like @embed.
+ */
+static void expand_random(HglStringView line, HglStringBuilder *out, HglStringView tokens)
+{
+    uint64_t size = 0;
+    uint64_t seed = 0;
+    bool has_size = false;
+    Attribute dist = {0};
+    HglStringView extern_name = {0};
+    HglStringView source_path = {0};
+    Attribute attr;
+    while (parse_attribute(line, &tokens, &attr)) {
+        if (hgl_sv_equals(attr.name, HGL_SV_LIT("bytes"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `bytes(N)`\n");
+            size = hgl_sv_to_u64(attr.args[0]);
+            has_size = true;
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("seed"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `seed(S)`\n");
+            seed = hgl_sv_to_u64(attr.args[0]);
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("dist"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args >= 1, "Expected `dist(KIND, ...)`\n");
+            dist = attr;
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("extern"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `extern(NAME)`\n");
+            extern_name = attr.args[0];
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("source"))) {
+            GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `source(PATH)`\n");
+            source_path = attr.args[0];
+        } else {
+            GEPT_ASSERT_LINE(line, false, "Unknown attribute `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr.name));
+        }
+    }
+    GEPT_ASSERT_LINE(line, has_size, "Expected `bytes(N)`\n");
+    GEPT_ASSERT_LINE(line, size <= SCRATCH_BUFFER_SIZE, "At most %d bytes can be generated\n", SCRATCH_BUFFER_SIZE);
+
+    uint8_t *data = scratch_buf;
+    bool is_normal = (dist.n_args > 0) && hgl_sv_equals(dist.args[0], HGL_SV_LIT("normal"));
+    if (!is_normal) {
+        random_fill(data, size, seed);
+    }
+
+    if (dist.n_args == 0 || hgl_sv_equals(dist.args[0], HGL_SV_LIT("uniform"))) {
+        /* raw bytes are uniform already */
+    } else if (hgl_sv_equals(dist.args[0], HGL_SV_LIT("range")) ||
+               hgl_sv_equals(dist.args[0], HGL_SV_LIT("ascii"))) {
+        bool is_ascii = hgl_sv_equals(dist.args[0], HGL_SV_LIT("ascii"));
+        GEPT_ASSERT_LINE(line, is_ascii ? dist.n_args == 1 : dist.n_args == 3,
+                         "Expected `dist(range, LO, HI)` or `dist(ascii)`\n");
+        uint32_t lo = is_ascii ? 0x20 : (uint32_t) hgl_sv_to_u64(dist.args[1]);
+        uint32_t hi = is_ascii ? 0x7E : (uint32_t) hgl_sv_to_u64(dist.args[2]);
+        GEPT_ASSERT_LINE(line, lo <= hi && hi <= 255, "Expected 0 <= LO <= HI <= 255\n");
+        /* maps a uniform byte onto [lo, hi] by multiply-shift, without a division */
+        uint32_t span = hi - lo + 1;
+        for (uint64_t i = 0; i < size; i++) {
+            data[i] = (uint8_t) (lo + ((data[i] * span) >> 8));
+        }
+    } else if (is_normal) {
+        GEPT_ASSERT_LINE(line, dist.n_args == 3, "Expected `dist(normal, MEAN, STDDEV)`\n");
+        double mean   = hgl_sv_to_f64(dist.args[1]);
+        double stddev = hgl_sv_to_f64(dist.args[2]);
+        /* Box-Muller, one SplitMix64 output (two 32-bit uniforms) per byte */
+        uint64_t seed2 = seed ^ 0x6E6F726D616C0000ULL;
+        for (uint64_t i = 0; i < size; i++) {
+            uint64_t x = splitmix64(&seed2);
+            double u1 = ((double) (x >> 32) + 1.0) / 4294967297.0;
+            double u2 = (double) (x & 0xFFFFFFFF) / 4294967296.0;
+            double v  = mean + stddev * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+            v = round(v);
+            data[i] = (uint8_t) ((v < 0.0) ? 0.0 : (v > 255.0) ? 255.0 : v);
+        }
+    } else {
+        GEPT_ASSERT_LINE(line, false, "Unknown distribution `"HGL_SV_FMT"`. Expected uniform, range, ascii "
+                         "or normal\n", HGL_SV_ARG(dist.args[0]));
+    }
+
+    append_embed_site(line, out, data, size, extern_name, source_path);
+}
+
+/**
+ * Returns the value of a monotonic clock in seconds.
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+/**
+ * Returns all jobserver tokens held by this process. Registered with `atexit` so
+ * tokens are not lost when gept exits on an error.
+ */
+static void jobserver_release_all(void)
+{
+    if (jobserver.read_fd == -1 || getpid() != jobserver.owner) {
+        return;
+    }
+    while (jobserver.n_tokens > 0) {
+        ssize_t n = write(jobserver.write_fd, &jobserver.tokens[jobserver.n_tokens - 1], 1);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        jobserver.n_tokens--;
+    }
+}
+
+/**
+ * Connects to the GNU make jobserver if `MAKEFLAGS` advertises one, either as an
+ * inherited pipe (`--jobserver-auth=R,W`, or `--jobserver-fds=R,W` for make < 4.2)
+ * or as a named pipe (`--jobserver-auth=fifo:PATH`, make >= 4.4). Make only passes
+ * the pipe to recipes it considers recursive (e.g. `+gept ...`), so the fds are
+ * checked before use.
+ */
+static void jobserver_init(void)
+{
+    const char *makeflags = getenv("MAKEFLAGS");
+    if (makeflags == NULL) {
+        return;
+    }
+
+    /* the last occurrence wins */
+    HglStringView auth = {0};
+    HglStringView flags = hgl_sv_from_cstr(makeflags);
+    while (flags.length > 0) {
+        HglStringView word = hgl_sv_lchop_until(&flags, ' ');
+        if (hgl_sv_lchop_if_starts_with(&word, "--jobserver-auth=") ||
+            hgl_sv_lchop_if_starts_with(&word, "--jobserver-fds=")) {
+            auth = word;
+        }
+    }
+    if (auth.length == 0 || auth.length >= 4096) {
+        return;
+    }
+
+    int fd = -1;
+    int write_fd = -1;
+    if (hgl_sv_lchop_if_starts_with(&auth, "fifo:")) {
+        char path[4096];
+        memcpy(path, auth.start, auth.length);
+        path[auth.length] = '\0';
+        fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        write_fd = fd;
+    } else {
+        int r = (int) hgl_sv_lchop_u64(&auth);
+        if (!hgl_sv_lchop_if_starts_with(&auth, ",")) {
+            return;
+        }
+        int w = (int) hgl_sv_lchop_u64(&auth);
+        if (fcntl(r, F_GETFD) == -1 || fcntl(w, F_GETFD) == -1) {
+            return;
+        }
+
+        /*
+         * The pipe is shared with make and every other client, so it can't be made
+         * non-blocking. Reopening it through /proc yields a private file description
+         * which can.
+         */
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", r);
+        fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        write_fd = w;
+    }
+    if (fd == -1) {
+        return;
+    }
+
+    jobserver.read_fd  = fd;
+    jobserver.write_fd = write_fd;
+    jobserver.owner    = getpid();
+    atexit(jobserver_release_all);
+}
+
+/**
+ * Tries to acquire a jobserver token without blocking.
+ */
+static bool jobserver_try_acquire(void)
+{
+    char token;
+    ssize_t n = read(jobserver.read_fd, &token, 1);
+    if (n != 1) {
+        return false;
+    }
+    jobserver.tokens = realloc(jobserver.tokens, jobserver.n_tokens + 1);
+    jobserver.tokens[jobserver.n_tokens++] = token;
+    return true;
+}
+
+/**
+ * Returns one jobserver token.
+ */
+static void jobserver_release(void)
+{
+    ssize_t n;
+    do {
+        n = write(jobserver.write_fd, &jobserver.tokens[jobserver.n_tokens - 1], 1);
+    } while (n == -1 && errno == EINTR);
+    GEPT_ASSERT(n == 1, "Failed to return a token to the jobserver. errno=%s\n", strerror(errno));
+    jobserver.n_tokens--;
+}
+
+/**
+ * Like `hgl_sv_trim`, but `sv` may be empty or all whitespace.
+ */
+static HglStringView sv_trim(HglStringView sv)
+{
+    sv = hgl_sv_ltrim(sv);
+    while (sv.length > 0 && isspace((unsigned char) sv.start[sv.length - 1])) {
+        sv.length--;
+    }
+    return sv;
+}
+
+/**
+ * Returns the interpreter of the script directive `directive`, or NULL if it isn't
+ * one.
+ */
+static Interpreter *interpreter_find(HglStringView directive)
+{
+    for (size_t i = 0; i < n_interpreters; i++) {
+        if (hgl_sv_equals_cstr(directive, interpreters[i]->directive)) {
+            return interpreters[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Registers the interpreter `argv` (NULL-terminated, taken over) for the script
+ * directive `directive`, replacing any earlier registration.
+ */
+static void interpreter_register(const char *directive, char **argv)
+{
+    Interpreter *interpreter = interpreter_find(hgl_sv_from_cstr(directive));
+    if (interpreter != NULL) {
+        for (char **arg = interpreter->argv; *arg != NULL; arg++) {
+            free(*arg);
+        }
+        free(interpreter->argv);
+        interpreter->argv = argv;
+        return;
+    }
+
+    interpreter = malloc(sizeof(*interpreter));
+    *interpreter = (Interpreter) {.directive = strdup(directive), .argv = argv};
+    interpreters = realloc(interpreters, (n_interpreters + 1) * sizeof(*interpreters));
+    interpreters[n_interpreters++] = interpreter;
+}
+
+/**
+ * Parses and registers the interpreter `entry` of the form `name = command line`,
+ * e.g. `python = python3 -S -E`. Words of the command line are separated by
+ * whitespace.
+ */
+static void interpreter_parse(HglStringView entry)
+{
+    GEPT_ASSERT(memchr(entry.start, '=', entry.length) != NULL, "Expected `name = command line` in interpreter `"
+                HGL_SV_FMT"`\n", HGL_SV_ARG(entry));
+    HglStringView name = sv_trim(hgl_sv_lchop_until(&entry, '='));
+    hgl_sv_lchop_if_starts_with(&name, "@");
+    GEPT_ASSERT(name.length > 0 && name.length < 64, "Expected `name = command line` in interpreter `"
+                HGL_SV_FMT"`\n", HGL_SV_ARG(entry));
+    for (size_t i = 0; i < name.length; i++) {
+        GEPT_ASSERT(isalnum((unsigned char) name.start[i]) || name.start[i] == '_' || name.start[i] == '-',
+                    "Invalid interpreter name `"HGL_SV_FMT"`\n", HGL_SV_ARG(name));
+    }
+    char directive[64 + 1];
+    snprintf(directive, sizeof(directive), "@"HGL_SV_FMT, HGL_SV_ARG(name));
+    /* the default interpreters may be replaced, other built-in directives not */
+    for (size_t i = 0; i < sizeof(builtin_directives) / sizeof(builtin_directives[0]); i++) {
+        GEPT_ASSERT(strcmp(directive, builtin_directives[i]) != 0 || interpreter_find(hgl_sv_from_cstr(directive)),
+                    "Interpreter `%s` shadows a built-in directive\n", directive);
+    }
+
+    /* room is left for firejail in `script_argv` */
+    char **argv = malloc(24 * sizeof(*argv));
+    int argc = 0;
+    entry = sv_trim(entry);
+    while (entry.length > 0) {
+        HglStringView word = hgl_sv_lchop_until(&entry, ' ');
+        entry = hgl_sv_ltrim(entry);
+        if (word.length == 0) {
+            continue;
+        }
+        GEPT_ASSERT(argc < 23, "Command line of interpreter `%s` is too long\n", directive);
+        argv[argc++] = hgl_sv_make_cstr_copy(word, NULL);
+    }
+    GEPT_ASSERT(argc > 0, "Missing command line for interpreter `%s`\n", directive);
+    argv[argc] = NULL;
+    interpreter_register(directive, argv);
+}
+
+/**
+ * Registers the default interpreters, then those of `spec`: either `;`-separated
+ * `name = command line` entries, or `@` followed by the path of a file with one entry
+ * per line.
+ * Empty lines and lines starting with `#` are ignored.
+ */
+static void interpreters_init(const char *spec)
+{
+    const char *bash   = (*opt_bash_path == NULL) ? "bash" : *opt_bash_path;
+    const char *python = (*opt_python_path == NULL) ? "python3" : *opt_python_path;
+    const char *perl   = (*opt_perl_path == NULL) ? "perl" : *opt_perl_path;
+    const char *defaults[][6] = {
+        {"@bash", bash, "--norc", "--noprofile", "-r", "-s"},
+        {"@python", python},
+        {"@perl", perl},
+    };
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+        char **argv = calloc(6, sizeof(*argv));
+        for (int k = 1; k < 6 && defaults[i][k] != NULL; k++) {
+            argv[k - 1] = strdup(defaults[i][k]);
+        }
+        interpreter_register(defaults[i][0], argv);
+    }
+
+    if (spec == NULL) {
+        return;
+    }
+    HglStringView entries = hgl_sv_from_cstr(spec);
+    char delim = ';';
+    if (spec[0] == '@') {
+        MappedFile *mf = mapped_file_get(spec + 1);
+        GEPT_ASSERT(mf != NULL, "Unable to open file `%s`\n", spec + 1);
+        entries = hgl_sv_from(mf->data, mf->size);
+        delim = '\n';
+    }
+    while (entries.length > 0) {
+        HglStringView entry = sv_trim(hgl_sv_lchop_until(&entries, delim));
+        if (entry.length == 0 || entry.start[0] == '#') {
+            continue;
+        }
+        interpreter_parse(entry);
+    }
+}
+
+/**
+ * Prints how many scripts every interpreter ran, and how long they took to start
+ * (produce their first output) and to finish.
+ */
+static void interpreters_print_stats(void)
+{
+    fprintf(stderr, "%-16s %8s %16s %16s\n", "interpreter", "runs", "startup (mean)", "total (mean)");
+    for (size_t i = 0; i < n_interpreters; i++) {
+        Interpreter *interpreter = interpreters[i];
+        double n = (interpreter->n_runs > 0) ? (double) interpreter->n_runs : 1.0;
+        fprintf(stderr, "%-16s %8zu %13.1f ms %13.1f ms\n", interpreter->directive, interpreter->n_runs,
+                1e3 * interpreter->startup_seconds / n, 1e3 * interpreter->seconds / n);
+    }
+}
+
+/**
+ * Frees the interpreter registry.
+ */
+static void interpreters_release(void)
+{
+    for (size_t i = 0; i < n_interpreters; i++) {
+        for (char **arg = interpreters[i]->argv; *arg != NULL; arg++) {
+            free(*arg);
+        }
+        free(interpreters[i]->argv);
+        free(interpreters[i]->directive);
+        free(interpreters[i]);
+    }
+    free(interpreters);
+    interpreters   = NULL;
+    n_interpreters = 0;
+}
+
+/**
+ * Fills `exec_argv` with the NULL-terminated command line which runs a script with
+ * `interpreter`.
+ */
+static void script_argv(const Interpreter *interpreter, char *exec_argv[32])
+{
+    int exec_argv_idx = 0;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+    /* There is no reasonable const-correct way to do this*/
+
+    /* 
+     * Run in a read-only view of the file system unless explicitly told "YOLO"
+     * by the user.
+     *
+     * TODO figure out what other flags to use.
+     */
+    if (!*opt_yolo) {
+        exec_argv[exec_argv_idx++] = (*opt_firejail_path == NULL) ? "firejail": *opt_firejail_path;
+        exec_argv[exec_argv_idx++] = "--read-only=~/";
+        exec_argv[exec_argv_idx++] = "--caps.drop=all";
+        exec_argv[exec_argv_idx++] = "--protocol=netlink";
+        exec_argv[exec_argv_idx++] = "--quiet";
+    }
+#pragma GCC diagnostic pop
+
+    for (char **arg = interpreter->argv; *arg != NULL; arg++) {
+        exec_argv[exec_argv_idx++] = *arg;
+    }
+    exec_argv[exec_argv_idx++] = NULL;
+}
+
+/**
+ * Returns the length of the name of the define `NAME=VALUE`.
+ */
+static size_t define_name_length(const char *define)
+{
+    return strchr(define, '=') - define;
+}
+
+/**
+ * Loads the variants file at `path`. Every line holds the path the expansion of a
+ * variant is written to, followed by its `NAME=VALUE` defines, separated by
+ * whitespace. Empty lines and lines starting with `#` are ignored. Names whose
+ * value isn't the same in every variant are collected in `varying_names`.
+ */
+static void variants_load(const char *path)
+{
+    MappedFile *mf = mapped_file_get(path);
+    GEPT_ASSERT(mf != NULL, "Unable to open variants file `%s`\n", path);
+
+    HglStringView lines = hgl_sv_from(mf->data, mf->size);
+    while (lines.length > 0) {
+        HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+        HglStringView tokens = hgl_sv_ltrim(line);
+        if (tokens.length == 0 || tokens.start[0] == '#') {
+            continue;
+        }
+        HglStringView output = hgl_sv_lchop_until_predicate(&tokens, isspace);
+        Variant variant = {.output = hgl_sv_make_cstr_copy(output, NULL)};
+        while ((tokens = hgl_sv_ltrim(tokens)).length > 0) {
+            HglStringView define = hgl_sv_lchop_until_predicate(&tokens, isspace);
+            GEPT_ASSERT_LINE(line, memchr(define.start, '=', define.length) != NULL && define.start[0] != '=',
+                             "Expected `<output> [NAME=VALUE]...`\n");
+            GEPT_ASSERT_LINE(line, variant.n_defines < MAX_VARIANT_DEFINES, "Too many defines\n");
+            variant.defines = realloc(variant.defines, (variant.n_defines + 1) * sizeof(*variant.defines));
+            variant.defines[variant.n_defines++] = hgl_sv_make_cstr_copy(define, NULL);
+        }
+        variants = realloc(variants, (n_variants + 1) * sizeof(*variants));
+        variants[n_variants++] = variant;
+    }
+    GEPT_ASSERT(n_variants > 0, "Variants file `%s` lists no variants\n", path);
+
+    /* a name varies unless every variant has the exact same define */
+    for (size_t i = 0; i < n_variants; i++) {
+        for (size_t j = 0; j < variants[i].n_defines; j++) {
+            const char *define = variants[i].defines[j];
+            size_t name_length = define_name_length(define);
+            bool is_varying = false;
+            for (size_t k = 0; k < n_variants && !is_varying; k++) {
+                bool has_define = false;
+                for (size_t l = 0; l < variants[k].n_defines && !has_define; l++) {
+                    has_define = (strcmp(variants[k].defines[l], define) == 0);
+                }
+                is_varying = !has_define;
+            }
+            for (size_t k = 0; k < n_varying_names && is_varying; k++) {
+                is_varying = (strlen(varying_names[k]) != name_length ||
+                              strncmp(varying_names[k], define, name_length) != 0);
+            }
+            if (is_varying) {
+                varying_names = realloc(varying_names, (n_varying_names + 1) * sizeof(*varying_names));
+                varying_names[n_varying_names++] = strndup(define, name_length);
+            }
+        }
+    }
+}
+
+/**
+ * Returns true if the define `NAME=VALUE` is the same in every variant.
+ */
+static bool define_is_shared(const char *define)
+{
+    size_t name_length = define_name_length(define);
+    for (size_t i = 0; i < n_varying_names; i++) {
+        if (strlen(varying_names[i]) == name_length && strncmp(varying_names[i], define, name_length) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Fills `defines` with the defines scripts of `variant` run with, and returns their
+ * number. Scripts shared by all variants (`variant` is SIZE_MAX) run with the
+ * defines which are the same in every variant.
+ */
+static size_t variant_defines(size_t variant, char *defines[MAX_VARIANT_DEFINES])
+{
+    size_t n = 0;
+    if (n_variants == 0) {
+        return 0;
+    }
+    const Variant *v = &variants[(variant == SIZE_MAX) ? 0 : variant];
+    for (size_t i = 0; i < v->n_defines; i++) {
+        if (variant != SIZE_MAX || define_is_shared(v->defines[i])) {
+            defines[n++] = v->defines[i];
+        }
+    }
+    return n;
+}
+
+/**
+ * Returns the name of a define which varies between variants that the script
+ * `source_code` mentions as a whole word, or NULL if there is none. Shared scripts
+ * which do are warned about, as they don't see the define.
+ */
+static const char *script_varying_name(HglStringBuilder *source_code)
+{
+    const char *end = source_code->cstr + source_code->length;
+    for (size_t i = 0; i < n_varying_names; i++) {
+        size_t length = strlen(varying_names[i]);
+        for (const char *p = source_code->cstr;
+             (p = memmem(p, end - p, varying_names[i], length)) != NULL; p += length) {
+            bool starts_word = (p == source_code->cstr) || !(isalnum((unsigned char) p[-1]) || p[-1] == '_');
+            bool ends_word   = (p + length == end) || !(isalnum((unsigned char) p[length]) || p[length] == '_');
+            if (starts_word && ends_word) {
+                return varying_names[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Frees the variants loaded by `variants_load`.
+ */
+static void variants_release(void)
+{
+    for (size_t i = 0; i < n_variants; i++) {
+        for (size_t j = 0; j < variants[i].n_defines; j++) {
+            free(variants[i].defines[j]);
+        }
+        free(variants[i].defines);
+        free(variants[i].output);
+    }
+    for (size_t i = 0; i < n_varying_names; i++) {
+        free(varying_names[i]);
+    }
+    free(variants);
+    free(varying_names);
+    variants        = NULL;
+    n_variants      = 0;
+    varying_names   = NULL;
+    n_varying_names = 0;
+}
+
+#ifdef TRACE_AUDIT_ARCH
+/**
+ * Installs the seccomp filter of `--trace-inputs`, which suspends every traced
+ * syscall until gept has read its path, and sends the listener fd to gept over
+ * `socket_fd`. Called in the child between `fork` and `exec`. Returns false on
+ * failure.
+ */
+static bool trace_install(int socket_fd)
+{
+    size_t n = sizeof(traced_syscalls) / sizeof(traced_syscalls[0]);
+    struct sock_filter filter[64];
+    unsigned short k = 0;
+    filter[k++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+    filter[k++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, TRACE_AUDIT_ARCH, 0, n + 1);
+    filter[k++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+    for (size_t i = 0; i < n; i++) {
+        filter[k++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, traced_syscalls[i].nr, n - i, 0);
+    }
+    filter[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    filter[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF);
+    struct sock_fprog prog = {.len = k, .filter = filter};
+
+    /* unprivileged processes may only install filters with no_new_privs set */
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        return false;
+    }
+    int fd = (int) syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+    if (fd == -1) {
+        return false;
+    }
+
+    char byte = 0;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL) {
+        return false;
+    }
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    bool ok = (sendmsg(socket_fd, &msg, 0) == 1);
+    close(fd);
+    return ok;
+}
+
+/**
+ * Receives the seccomp listener fd sent by `trace_install`. Returns -1 if the
+ * child failed to install its filter.
+ */
+static int trace_receive_listener(int socket_fd)
+{
+    char byte;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+    ssize_t n;
+    while ((n = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR) {}
+    struct cmsghdr *cmsg = (n == 1) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+/**
+ * Reads the NULL-terminated string at `addr` in the memory of process `pid` into
+ * `buf`. Reads never cross a page boundary past the terminator, which may be
+ * followed by unmapped memory. Returns false if the string can't be read or
+ * doesn't fit.
+ */
+static bool trace_read_string(pid_t pid, uint64_t addr, char *buf, size_t size)
+{
+    size_t n = 0;
+    while (n < size) {
+        size_t chunk = 4096 - ((addr + n) & 4095);
+        chunk = (chunk < size - n) ? chunk : size - n;
+        struct iovec local  = {.iov_base = buf + n, .iov_len = chunk};
+        struct iovec remote = {.iov_base = (void *) (uintptr_t) (addr + n), .iov_len = chunk};
+        ssize_t n_read = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (n_read <= 0) {
+            return false;
+        }
+        if (memchr(buf + n, '\0', n_read) != NULL) {
+            return true;
+        }
+        n += n_read;
+    }
+    return false;
+}
+
+/**
+ * Resolves the path `raw`, passed to a syscall by process `pid` relative to
+ * `dirfd` (as in `openat`), and normalizes it lexically. Paths below the working
+ * directory of gept are made relative to it, so cache entries can be shared
+ * between checkouts. Returns false if the path can't be resolved.
+ */
+static bool trace_resolve(pid_t pid, int dirfd, const char *raw, char *path, size_t size)
+{
+    static char cwd[PATH_MAX];
+    if (cwd[0] == '\0' && getcwd(cwd, sizeof(cwd)) == NULL) {
+        return false;
+    }
+
+    char joined[2 * PATH_MAX];
+    if (raw[0] == '/') {
+        snprintf(joined, sizeof(joined), "%s", raw);
+    } else {
+        char link[64];
+        char base[PATH_MAX];
+        if (dirfd == AT_FDCWD) {
+            snprintf(link, sizeof(link), "/proc/%d/cwd", (int) pid);
+        } else {
+            snprintf(link, sizeof(link), "/proc/%d/fd/%d", (int) pid, dirfd);
+        }
+        ssize_t n = readlink(link, base, sizeof(base) - 1);
+        if (n <= 0) {
+            return false;
+        }
+        base[n] = '\0';
+        snprintf(joined, sizeof(joined), "%s/%s", base, raw);
+    }
+
+    /* drop empty and `.` components, and `..` along with the component before it */
+    size_t length = 0;
+    HglStringView rest = hgl_sv_from_cstr(joined);
+    while (rest.length > 0) {
+        HglStringView component = hgl_sv_lchop_until(&rest, '/');
+        if (component.length == 0 || hgl_sv_equals(component, HGL_SV_LIT("."))) {
+            continue;
+        }
+        if (hgl_sv_equals(component, HGL_SV_LIT(".."))) {
+            while (length > 0 && path[--length] != '/') {}
+            continue;
+        }
+        if (length + component.length + 2 > size) {
+            return false;
+        }
+        path[length++] = '/';
+        memcpy(path + length, component.start, component.length);
+        length += component.length;
+    }
+    if (length == 0) {
+        path[length++] = '/';
+    }
+    path[length] = '\0';
+
+    size_t cwd_length = strlen(cwd);
+    if (strncmp(path, cwd, cwd_length) == 0 && path[cwd_length] == '/' && cwd_length > 1) {
+        memmove(path, path + cwd_length + 1, length - cwd_length);
+    } else if (strcmp(path, cwd) == 0) {
+        strcpy(path, ".");
+    }
+    return true;
+}
+
+/**
+ * Records `path` as an input of `job`, unless it's a system file.
+ */
+static void trace_record(ScriptJob *job, const char *path, bool contents)
+{
+    for (size_t i = 0; i < sizeof(trace_ignored_prefixes) / sizeof(trace_ignored_prefixes[0]); i++) {
+        if (strncmp(path, trace_ignored_prefixes[i], strlen(trace_ignored_prefixes[i])) == 0) {
+            return;
+        }
+    }
+    if (strchr(path, '\n') != NULL) {
+        return; /* can't be stored in a manifest */
+    }
+    for (size_t i = 0; i < job->n_inputs; i++) {
+        if (strcmp(job->inputs[i].path, path) == 0) {
+            job->inputs[i].contents |= contents;
+            return;
+        }
+    }
+    job->inputs = realloc(job->inputs, (job->n_inputs + 1) * sizeof(*job->inputs));
+    job->inputs[job->n_inputs++] = (TracedInput) {.path = strdup(path), .contents = contents};
+}
+
+/**
+ * Handles one seccomp notification of the script of `job`: records the path the
+ * syscall reads and lets the syscall continue. The kernel re-reads the path when
+ * the syscall continues, so a script could pass a different path than the one
+ * recorded. Tracing is meant to find inputs, not to contain scripts.
+ */
+static void trace_handle(ScriptJob *job)
+{
+    static union {
+        struct seccomp_notif notif;
+        uint8_t bytes[512];
+    } req;
+    static union {
+        struct seccomp_notif_resp resp;
+        uint8_t bytes[512];
+    } resp;
+    static struct seccomp_notif_sizes sizes;
+    if (sizes.seccomp_notif == 0) {
+        GEPT_ASSERT(syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == 0 &&
+                    sizes.seccomp_notif <= sizeof(req) && sizes.seccomp_notif_resp <= sizeof(resp),
+                    "Unsupported seccomp notification sizes\n");
+    }
+
+    /* the kernel requires a zeroed buffer */
+    memset(&req, 0, sizeof(req));
+    if (ioctl(job->notify_fd, SECCOMP_IOCTL_NOTIF_RECV, &req) != 0) {
+        return; /* interrupted, or the process died */
+    }
+
+    const TracedSyscall *sc = NULL;
+    for (size_t i = 0; i < sizeof(traced_syscalls) / sizeof(traced_syscalls[0]); i++) {
+        if (traced_syscalls[i].nr == req.notif.data.nr) {
+            sc = &traced_syscalls[i];
+        }
+    }
+    if (sc != NULL) {
+        uint64_t flags = (sc->flags_arg >= 0) ? req.notif.data.args[sc->flags_arg] : O_RDONLY;
+        bool is_write_only = ((flags & O_ACCMODE) == O_WRONLY);
+        bool contents = sc->contents && !(flags & O_PATH);
+        int dirfd = (sc->dirfd_arg >= 0) ? (int) req.notif.data.args[sc->dirfd_arg] : AT_FDCWD;
+        char raw[PATH_MAX];
+        char path[PATH_MAX];
+        if (!is_write_only &&
+            trace_read_string(req.notif.pid, req.notif.data.args[sc->path_arg], raw, sizeof(raw)) &&
+            raw[0] != '\0' &&
+            trace_resolve(req.notif.pid, dirfd, raw, path, sizeof(path)) &&
+            /* the process may have died, and its pid been reused, while the path was read */
+            ioctl(job->notify_fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &req.notif.id) == 0) {
+            trace_record(job, path, contents);
+        }
+    }
+
+    memset(&resp, 0, sizeof(resp));
+    resp.resp.id    = req.notif.id;
+    resp.resp.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+    ioctl(job->notify_fd, SECCOMP_IOCTL_NOTIF_SEND, &resp); /* fails if the process died. That's fine */
+}
+#endif
+
+/**
+ * Writes `size` bytes of `data` to the compiler of `stream`. A compiler which exits
+ * early closes its stdin, and is then left alone: its exit status reports the error.
+ */
+static void cc_stream_write(CcStream *stream, const char *data, size_t size)
+{
+    while (size > 0 && stream->stdin_fd != -1) {
+        ssize_t n = write(stream->stdin_fd, data, size);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EPIPE) {
+            close(stream->stdin_fd);
+            stream->stdin_fd = -1;
+            return;
+        }
+        GEPT_ASSERT(n > 0, "Failed to write to the compiler. errno=%s\n", strerror(errno));
+        data += n;
+        size -= n;
+    }
+}
+
+/**
+ * Writes everything of the output of `stream` which is final to its compiler: the
+ * expansion up to the first script which is still running, with the output of the
+ * scripts before it spliced in. Text is only ever appended to the output, so what
+ * precedes its current end is final. Once the output is complete and written, the
+ * compiler's stdin is closed.
+ */
+static void cc_stream_advance(CcStream *stream)
+{
+    const HglStringBuilder *sb = stream->sb;
+    while (stream->stdin_fd != -1) {
+        while (stream->next_job < n_jobs && jobs[stream->next_job]->sink != sb) {
+            stream->next_job++;
+        }
+        if (stream->next_job == n_jobs) {
+            cc_stream_write(stream, sb->cstr + stream->n_streamed, sb->length - stream->n_streamed);
+            stream->n_streamed = sb->length;
+            if (stream->is_complete && stream->stdin_fd != -1) {
+                close(stream->stdin_fd);
+                stream->stdin_fd = -1;
+            }
+            return;
+        }
+
+        ScriptJob *job = jobs[stream->next_job];
+        cc_stream_write(stream, sb->cstr + stream->n_streamed, job->offset - stream->n_streamed);
+        stream->n_streamed = job->offset;
+        if (!job->done) {
+            return;
+        }
+        cc_stream_write(stream, job->result.cstr, job->result.length);
+        stream->next_job++;
+    }
+}
+
+/**
+ * Advances every stream with `cc_stream_advance`. Called whenever a script is added
+ * or finishes.
+ */
+static void cc_streams_advance(void)
+{
+    for (size_t i = 0; i < n_cc_streams; i++) {
+        cc_stream_advance(cc_streams[i]);
+    }
+}
+
+/**
+ * Adds a job for the script directive at `line`. Its output is spliced into `sink`
+ * at the current end once all scripts are done.
+ */
+static ScriptJob *job_add(HglStringView line, HglStringBuilder *sink)
+{
+    cc_streams_advance(); /* the output before the script is final */
+
+    ScriptJob *job = malloc(sizeof(*job));
+    *job = (ScriptJob) {
+        .stdout_fd   = -1,
+        .result      = hgl_sb_make(.initial_capacity = 4096),
+        .sink        = sink,
+        .offset      = sink->length,
+        .line        = line,
+        .start_time  = now_seconds(),
+        .batch_entry = current_batch_entry,
+        .variant     = SIZE_MAX,
+        .depth       = (current_parent_job == NULL) ? 0 : current_parent_job->depth + 1,
+        .parent      = current_parent_job,
+        .notify_fd   = -1,
+    };
+    jobs = realloc(jobs, (n_jobs + 1) * sizeof(*jobs));
+    jobs[n_jobs++] = job;
+    return job;
+}
+
+/**
+ * Forks and execs `job->interpreter` with `source_code` on its stdin. Its output is read into `job->result`.
+ */
+static void script_spawn(ScriptJob *job, HglStringBuilder *source_code, bool holds_token)
+{
+    int pipes[2][2]; // {{input read end, input write end},
+                     //  {output read end, output write end}}
+    int trace_sockets[2] = {-1, -1};
+    if (*opt_trace_inputs) {
+        /*
+         * A traced script may block in a syscall until gept handles its notification,
+         * before it has read its stdin. Writing to a pipe could then deadlock the two,
+         * so traced scripts read their source from a memfd instead.
+         */
+        pipes[0][0] = memfd_create("gept-script", MFD_CLOEXEC);
+        pipes[0][1] = -1;
+        GEPT_ASSERT(pipes[0][0] != -1 &&
+                    write(pipes[0][0], source_code->cstr, source_code->length) == (ssize_t) source_code->length &&
+                    lseek(pipes[0][0], 0, SEEK_SET) == 0,
+                    "Failed to write script to a memfd. errno=%s\n", strerror(errno));
+        GEPT_ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, trace_sockets) == 0,
+                    "Failed to create sockets. errno=%s\n", strerror(errno));
+    } else {
+        GEPT_ASSERT(pipe2(pipes[0], O_CLOEXEC) == 0, "Failed to create pipes");
+    }
+    GEPT_ASSERT(pipe2(pipes[1], O_CLOEXEC) == 0, "Failed to create pipes");
+
+    pid_t pid = fork();
+    GEPT_ASSERT(pid != -1, "Call to `fork` failed. errno=%s\n", strerror(errno));
+
+    /* ======== child ======== */
+    if (pid == 0) {
+        /* Replace stdin & stdout with respective pipe. The rest are closed on exec */
+        dup2(pipes[0][0], STDIN_FILENO);
+        dup2(pipes[1][1], STDOUT_FILENO);
+        //dup2(devnull, STDERR_FILENO);
+        signal(SIGPIPE, SIG_DFL); /* ignored by gept itself with `--cc` */
+
+        char *exec_argv[32];
+        script_argv(job->interpreter, exec_argv);
+
+        /* with `--variants`, scripts see the defines of their variant */
+        char *defines[MAX_VARIANT_DEFINES];
+        size_t n_defines = variant_defines(job->variant, defines);
+        for (size_t i = 0; i < n_defines; i++) {
+            putenv(defines[i]);
+        }
+
+#ifdef TRACE_AUDIT_ARCH
+        if (trace_sockets[1] != -1 && !trace_install(trace_sockets[1])) {
+            fprintf(stderr, "ERROR (IN CHILD): failed to install seccomp filter. errno=%s\n",
+                    strerror(errno));
+            _exit(1);
+        }
+#endif
+
+        /* on success `execve` doesn't return */
+        if (-1 == execvp(exec_argv[0], exec_argv)) {
+            fprintf(stderr, "ERROR (IN CHILD): failed to exec file. errno=%s\n",
+                    strerror(errno));
+            _exit(1);
+        }
+        GEPT_ASSERT(0, "unreachable");
+    }
+
+    /* ======== parent ======== */
+
+    /* close unused ends of pipes */
+    close(pipes[0][0]);
+    close(pipes[1][1]);
+
+    /*
+     * Write source code contents on the stdin of the process then
+     * immediately close the pipe.
+     */
+    if (pipes[0][1] != -1) {
+        ssize_t n_written_bytes = write(pipes[0][1], source_code->cstr, source_code->length);
+        (void) n_written_bytes;
+        close(pipes[0][1]);
+    }
+
+#ifdef TRACE_AUDIT_ARCH
+    if (trace_sockets[0] != -1) {
+        close(trace_sockets[1]);
+        job->notify_fd = trace_receive_listener(trace_sockets[0]);
+        close(trace_sockets[0]);
+        GEPT_ASSERT_LINE(job->line, job->notify_fd != -1, "Unable to trace the inputs of the script\n");
+    }
+#endif
+
+    job->pid         = pid;
+    job->stdout_fd   = pipes[1][0];
+    job->holds_token = holds_token;
+    job->start_time  = now_seconds();
+    n_running_jobs++;
+}
+
+/**
+ * Waits until the output of at least one running script has been read, or, if
+ * `want_token` is set, a jobserver token might be available. Scripts which reach
+ * EOF are reaped and their jobserver tokens returned.
+ */
+static void jobs_poll(bool want_token)
+{
+    struct pollfd *fds = malloc((2 * n_running_jobs + 1) * sizeof(*fds));
+    size_t *job_indices = malloc((2 * n_running_jobs + 1) * sizeof(*job_indices));
+    nfds_t n_fds = 0;
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (!jobs[i]->done && !jobs[i]->is_pending) {
+            fds[n_fds] = (struct pollfd) {.fd = jobs[i]->stdout_fd, .events = POLLIN};
+            job_indices[n_fds++] = i;
+        }
+        if (!jobs[i]->done && jobs[i]->notify_fd != -1) {
+            fds[n_fds] = (struct pollfd) {.fd = jobs[i]->notify_fd, .events = POLLIN};
+            job_indices[n_fds++] = i;
+        }
+    }
+    if (want_token) {
+        fds[n_fds++] = (struct pollfd) {.fd = jobserver.read_fd, .events = POLLIN};
+    }
+
+    double start_time = now_seconds();
+    int n_ready = poll(fds, n_fds, -1);
+    jobs_poll_seconds += now_seconds() - start_time;
+    GEPT_ASSERT(n_ready != -1 || errno == EINTR, "Call to `poll` failed. errno=%s\n", strerror(errno));
+
+    for (nfds_t i = 0; n_ready > 0 && i < n_fds; i++) {
+        if (fds[i].revents == 0 || fds[i].fd == jobserver.read_fd) {
+            continue;
+        }
+
+        ScriptJob *job = jobs[job_indices[i]];
+#ifdef TRACE_AUDIT_ARCH
+        if (fds[i].fd == job->notify_fd) {
+            if (fds[i].revents & POLLIN) {
+                trace_handle(job);
+            }
+            continue;
+        }
+#endif
+        if (job->done) {
+            continue; /* reaped while handling a notification */
+        }
+        char buf[65536];
+        ssize_t n = read(job->stdout_fd, buf, sizeof(buf));
+        if (n > 0) {
+            if (!job->has_output) {
+                job->has_output   = true;
+                job->startup_time = now_seconds();
+            }
+            hgl_sb_append(&job->result, buf, n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        /* EOF: wait for process to terminate */
+        close(job->stdout_fd);
+        job->stdout_fd = -1;
+        pid_t wait_pid;
+        int wstatus = 0;
+        while ((wait_pid = waitpid(job->pid, &wstatus, (job->notify_fd == -1) ? 0 : WNOHANG)) != job->pid) {
+            GEPT_ASSERT_LINE(job->line, wait_pid != -1, "Child process returned an error");
+#ifdef TRACE_AUDIT_ARCH
+            /* a traced script may still be waiting for a notification to be handled */
+            struct pollfd notify = {.fd = job->notify_fd, .events = POLLIN};
+            if (poll(&notify, 1, 10) == 1 && (notify.revents & POLLIN)) {
+                trace_handle(job);
+            }
+#endif
+        }
+        GEPT_ASSERT_LINE(job->line, WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0,
+                         "Child process exited with the error code: %d\n", WEXITSTATUS(wstatus));
+        if (job->notify_fd != -1) {
+            close(job->notify_fd);
+            job->notify_fd = -1;
+        }
+        job->done = true;
+        n_running_jobs--;
+        double end_time = now_seconds();
+        job->seconds = end_time - job->start_time;
+        job->interpreter->n_runs++;
+        job->interpreter->startup_seconds += (job->has_output ? job->startup_time : end_time) - job->start_time;
+        job->interpreter->seconds += end_time - job->start_time;
+        if (job->batch_entry != SIZE_MAX) {
+            batch[job->batch_entry].seconds += now_seconds() - job->start_time;
+        }
+        if (job->holds_token) {
+            jobserver_release();
+        }
+        cc_streams_advance();
+    }
+
+    free(fds);
+    free(job_indices);
+}
+
+/**
+ * Returns true if another script may be started right away, i.e. fewer than
+ * `--jobs` scripts are running and, when running under make, a jobserver token
+ * could be acquired (into `holds_token`) unless no script is running.
+ */
+static bool jobs_try_slot(bool *holds_token)
+{
+    *holds_token = false;
+    if (n_running_jobs == 0) {
+        return true;
+    }
+    if (n_running_jobs >= max_jobs) {
+        return false;
+    }
+    if (jobserver.read_fd == -1) {
+        return true;
+    }
+    *holds_token = jobserver_try_acquire();
+    return *holds_token;
+}
+
+/**
+ * Blocks until another script may be started, i.e. fewer than `--jobs` scripts
+ * are running and, when running under make, a jobserver token has been acquired
+ * for every script but the first (which runs on the token make gave gept itself).
+ * Returns true if a token was acquired.
+ */
+static bool jobs_wait_for_slot(void)
+{
+    bool holds_token;
+    while (!jobs_try_slot(&holds_token)) {
+        jobs_poll((n_running_jobs < max_jobs) && (jobserver.read_fd != -1));
+    }
+    return holds_token;
+}
+
+/**
+ * Waits for all running scripts to finish.
+ */
+static void jobs_wait_all(void)
+{
+    while (n_running_jobs > 0) {
+        jobs_poll(false);
+    }
+}
+
+/**
+ * Starts pending scripts while there are free slots, the longest expected first
+ * (ties in template order). Starting long scripts first keeps them from ending up
+ * on the critical path. With `wait`, blocks until every pending script has started.
+ */
+static void jobs_dispatch(bool wait)
+{
+    while (n_pending_jobs > 0) {
+        bool holds_token;
+        if (wait) {
+            holds_token = jobs_wait_for_slot();
+        } else if (!jobs_try_slot(&holds_token)) {
+            return;
+        }
+
+        ScriptJob *next = NULL;
+        for (size_t i = 0; i < n_jobs; i++) {
+            if (jobs[i]->is_pending && (next == NULL || jobs[i]->expected_seconds > next->expected_seconds)) {
+                next = jobs[i];
+            }
+        }
+        GEPT_ASSERT(next != NULL, "unreachable");
+        next->is_pending = false;
+        n_pending_jobs--;
+        script_spawn(next, &next->source, holds_token);
+        hgl_sb_destroy(&next->source);
+        next->source = (HglStringBuilder) {0};
+    }
+}
+
+/**
+ * Computes the cache key of a script run for `variant`: a SHA-256 of everything
+ * that determines how it runs. Scripts are assumed to be deterministic functions
+ * of their source.
+ */
+static void script_cache_key(const Interpreter *interpreter, HglStringBuilder *source_code, size_t variant,
+                             uint8_t key[32])
+{
+    const char *firejail = *opt_yolo ? "yolo" : (*opt_firejail_path == NULL) ? "firejail" : *opt_firejail_path;
+
+    HglSha256 ctx;
+    hgl_hash_sha256_init(&ctx);
+    hgl_hash_sha256_update(&ctx, "gept-script-v2", sizeof("gept-script-v2"));
+    hgl_hash_sha256_update(&ctx, interpreter->directive, strlen(interpreter->directive) + 1);
+    for (char **arg = interpreter->argv; *arg != NULL; arg++) {
+        hgl_hash_sha256_update(&ctx, *arg, strlen(*arg) + 1);
+    }
+    hgl_hash_sha256_update(&ctx, "", 1);
+    hgl_hash_sha256_update(&ctx, firejail, strlen(firejail) + 1);
+    if (*opt_trace_inputs) {
+        hgl_hash_sha256_update(&ctx, "traced", sizeof("traced"));
+    }
+    char *defines[MAX_VARIANT_DEFINES];
+    size_t n_defines = variant_defines(variant, defines);
+    for (size_t i = 0; i < n_defines; i++) {
+        hgl_hash_sha256_update(&ctx, defines[i], strlen(defines[i]) + 1);
+    }
+    hgl_hash_sha256_update(&ctx, source_code->cstr, source_code->length);
+    hgl_hash_sha256_final(&ctx, key);
+}
+
+/**
+ * Writes the path of the entry `hex` in the local cache to `path`, creating its
+ * directory if needed.
+ */
+static void local_cache_path(const char *hex, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%.2s", *opt_cache_dir, hex);
+    mkdir(*opt_cache_dir, 0755);
+    mkdir(path, 0755);
+    size_t n = strlen(path);
+    snprintf(path + n, size - n, "/%s", hex);
+}
+
+/**
+ * Appends the contents of the file at `path` to `sb`. Returns false, leaving `sb`
+ * unchanged, if the file can't be read.
+ */
+static bool read_file(const char *path, HglStringBuilder *sb)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    size_t length = sb->length;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        hgl_sb_append(sb, buf, n);
+    }
+    close(fd);
+    if (n == -1) {
+        sb->length = length;
+        sb->cstr[length] = '\0';
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes `size` bytes of `data` to `path` atomically, so concurrent readers (e.g.
+ * other gept processes sharing the cache) never see a partial file.
+ */
+static bool write_file_atomic(const char *path, const char *data, size_t size)
+{
+    char tmp_path[4096 + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int) getpid());
+    FILE *fp = fopen(tmp_path, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    bool ok = (fwrite(data, 1, size, fp) == size);
+    ok = (fclose(fp) == 0) && ok;
+    ok = ok && (rename(tmp_path, path) == 0);
+    if (!ok) {
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+/**
+ * Returns the history of the template of batch entry `batch_entry` (SIZE_MAX for
+ * the template given with `-i`), loading it from `--history` on first use. Its
+ * file is named after a hash of the template path and holds one `<block hash>
+ * <seconds>` line per script block.
+ */
+static History *history_get(size_t batch_entry)
+{
+    size_t index = (batch_entry == SIZE_MAX) ? 0 : batch_entry;
+    if (histories == NULL) {
+        n_histories = (n_batch > 0) ? n_batch : 1;
+        histories = calloc(n_histories, sizeof(*histories));
+    }
+    History *history = &histories[index];
+    if (history->path != NULL) {
+        return history;
+    }
+
+    const char *template_path = (batch_entry == SIZE_MAX) ? *opt_infile : batch[batch_entry].input;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx.history", *opt_history,
+             (unsigned long long) hgl_hash_xxh64(template_path, strlen(template_path), 0));
+    history->path = strdup(path);
+    history->template_path = template_path;
+
+    HglStringBuilder sb = hgl_sb_make(.initial_capacity = 4096);
+    if (read_file(path, &sb)) {
+        HglStringView lines = hgl_sv_from_sb(&sb);
+        while (lines.length > 0) {
+            HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+            if (line.length == 0 || line.start[0] == '#') {
+                continue;
+            }
+            char *end;
+            uint64_t block_hash = strtoull(line.start, &end, 16);
+            double seconds = strtod(end, &end);
+            if (*end != '\n' || seconds < 0.0) {
+                continue; /* malformed. The history is only a hint */
+            }
+            history->entries = realloc(history->entries, (history->n_entries + 1) * sizeof(*history->entries));
+            history->entries[history->n_entries++] = (HistoryEntry) {.block_hash = block_hash, .seconds = seconds};
+        }
+    }
+    hgl_sb_destroy(&sb);
+    return history;
+}
+
+/**
+ * Returns the entry of `job` in the history of its template, or NULL if its block
+ * has never run.
+ */
+static HistoryEntry *history_entry(const ScriptJob *job)
+{
+    History *history = history_get(job->batch_entry);
+    for (size_t i = 0; i < history->n_entries; i++) {
+        if (history->entries[i].block_hash == job->block_hash) {
+            return &history->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Returns the expected run time of `job` in seconds: its duration in the history
+ * of its template, if it ran before. Else, the mean duration of the scripts of its
+ * interpreter in this run, or of the blocks in the history, or 50 ms. Without
+ * `--history`, only the last two apply.
+ */
+static double history_expect(const ScriptJob *job)
+{
+    History *history = NULL;
+    if (*opt_history != NULL) {
+        HistoryEntry *entry = history_entry(job);
+        if (entry != NULL) {
+            entry->is_current = true;
+            return entry->seconds;
+        }
+        history = history_get(job->batch_entry);
+    }
+    if (job->interpreter->n_runs > 0) {
+        return job->interpreter->seconds / (double) job->interpreter->n_runs;
+    }
+    if (history == NULL || history->n_entries == 0) {
+        return 0.05;
+    }
+    double total = 0.0;
+    for (size_t i = 0; i < history->n_entries; i++) {
+        total += history->entries[i].seconds;
+    }
+    return total / (double) history->n_entries;
+}
+
+/**
+ * Returns true if the scripts of the template of `job` are worth holding back until
+ * the template has been expanded, so `jobs_dispatch` can start the longest first.
+ * That is only the case once its history knows the durations of several blocks.
+ */
+static bool history_is_sortable(const ScriptJob *job)
+{
+    return *opt_history != NULL && history_get(job->batch_entry)->n_entries > 1;
+}
+
+/**
+ * Records that `job` ran for `seconds` in the history of its template. Durations
+ * are averaged with those of previous runs, so a single outlier doesn't dominate.
+ */
+static void history_record(const ScriptJob *job, double seconds)
+{
+    if (*opt_history == NULL) {
+        return;
+    }
+    HistoryEntry *entry = history_entry(job);
+    if (entry == NULL) {
+        History *history = history_get(job->batch_entry);
+        history->entries = realloc(history->entries, (history->n_entries + 1) * sizeof(*history->entries));
+        entry = &history->entries[history->n_entries++];
+        *entry = (HistoryEntry) {.block_hash = job->block_hash, .seconds = seconds};
+    }
+    entry->seconds    = 0.5 * (entry->seconds + seconds);
+    entry->is_current = true;
+}
+
+/**
+ * Writes the history of every template expanded in this run to `--history`.
+ * Blocks which are no longer in their template are dropped.
+ */
+static void histories_write(void)
+{
+    mkdir(*opt_history, 0755);
+    for (size_t i = 0; i < n_histories; i++) {
+        History *history = &histories[i];
+        if (history->path == NULL) {
+            continue;
+        }
+        HglStringBuilder sb = hgl_sb_make(.initial_capacity = 4096);
+        hgl_sb_append_fmt(&sb, "# gept script durations of %s\n", history->template_path);
+        for (size_t j = 0; j < history->n_entries; j++) {
+            if (history->entries[j].is_current) {
+                hgl_sb_append_fmt(&sb, "%016llx %.6f\n", (unsigned long long) history->entries[j].block_hash,
+                                  history->entries[j].seconds);
+            }
+        }
+        if (!write_file_atomic(history->path, sb.cstr, sb.length)) {
+            fprintf(stderr, "  WARNING: unable to write history `%s`. errno=%s\n", history->path, strerror(errno));
+        }
+        hgl_sb_destroy(&sb);
+    }
+}
+
+/**
+ * Frees the histories loaded by `history_get`.
+ */
+static void histories_release(void)
+{
+    for (size_t i = 0; i < n_histories; i++) {
+        free(histories[i].path);
+        free(histories[i].entries);
+    }
+    free(histories);
+    histories   = NULL;
+    n_histories = 0;
+}
+
+/**
+ * Warns about a failed remote cache operation and disables the remote cache for
+ * the rest of the run. Remote cache failures are never fatal.
+ */
+static void remote_cache_fail(const char *what)
+{
+    fprintf(stderr, "  WARNING: remote cache %s failed (%s). Continuing without it.\n",
+            what, (errno != 0) ? strerror(errno) : "bad response");
+    remote_cache.enabled = false;
+}
+
+/**
+ * Parses the remote cache URL, of the form `http://host[:port][/prefix]`, and
+ * resolves its host.
+ */
+static void remote_cache_init(const char *url)
+{
+    HglStringView sv = hgl_sv_from_cstr(url);
+    GEPT_ASSERT(hgl_sv_lchop_if_starts_with(&sv, "http://"),
+                "Unsupported remote cache URL `%s`. Expected http://host[:port][/prefix]\n", url);
+    HglStringView authority = hgl_sv_lchop_until(&sv, '/');
+    HglStringView host = hgl_sv_lchop_until(&authority, ':');
+    HglStringView port = (authority.length > 0) ? authority : HGL_SV_LIT("80");
+    GEPT_ASSERT(host.length > 0 && host.length < sizeof(remote_cache.host) &&
+                port.length < sizeof(remote_cache.port) && sv.length + 1 < sizeof(remote_cache.prefix),
+                "Invalid remote cache URL `%s`\n", url);
+    while (sv.length > 0 && sv.start[sv.length - 1] == '/') {
+        sv.length--;
+    }
+
+    memcpy(remote_cache.host, host.start, host.length);
+    memcpy(remote_cache.port, port.start, port.length);
+    snprintf(remote_cache.prefix, sizeof(remote_cache.prefix), "%s"HGL_SV_FMT,
+             (sv.length > 0) ? "/" : "", HGL_SV_ARG(sv));
+
+    /* getaddrinfo can't be given a timeout, so it is only called once */
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    int err = getaddrinfo(remote_cache.host, remote_cache.port, &hints, &remote_cache.addrs);
+    if (err != 0) {
+        fprintf(stderr, "  WARNING: unable to resolve remote cache host `%s` (%s). Continuing without it.\n",
+                remote_cache.host, gai_strerror(err));
+        remote_cache.addrs = NULL;
+        return;
+    }
+    remote_cache.enabled = true;
+}
+
+/**
+ * Frees the addresses resolved by `remote_cache_init`.
+ */
+static void remote_cache_release(void)
+{
+    if (remote_cache.addrs != NULL) {
+        freeaddrinfo(remote_cache.addrs);
+        remote_cache.addrs = NULL;
+    }
+}
+
+/**
+ * Waits until `fd` is ready for `events`, or until `deadline` (see `now_seconds`)
+ * has passed. Returns false on timeout or failure.
+ */
+static bool remote_cache_wait(int fd, short events, double deadline)
+{
+    for (;;) {
+        double remaining = deadline - now_seconds();
+        if (remaining <= 0.0) {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        struct pollfd pfd = {.fd = fd, .events = events};
+        int n = poll(&pfd, 1, (int) ceil(remaining * 1000.0));
+        if (n > 0) {
+            return true;
+        }
+        if (n == -1 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Connects to the remote cache, giving up at `deadline`. The socket is left in
+ * non-blocking mode.
+ */
+static int remote_cache_connect(double deadline)
+{
+    int fd = -1;
+    for (struct addrinfo *ai = remote_cache.addrs; ai != NULL && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        int err = connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (err == -1 && errno == EINPROGRESS) {
+            int so_error = 0;
+            socklen_t len = sizeof(so_error);
+            if (remote_cache_wait(fd, POLLOUT, deadline) &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) == 0 && so_error == 0) {
+                err = 0;
+            } else if (so_error != 0) {
+                errno = so_error;
+            }
+        }
+        if (err == -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * Receives the next bytes of a reply into `reply`, giving up at `deadline`. Returns
+ * the number of bytes received, 0 when the server has closed the connection, or -1
+ * on timeout or failure.
+ */
+static ssize_t remote_cache_recv(int fd, HglStringBuilder *reply, double deadline)
+{
+    char buf[65536];
+    for (;;) {
+        if (!remote_cache_wait(fd, POLLIN, deadline)) {
+            return -1;
+        }
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (n > 0) {
+            hgl_sb_append(reply, buf, n);
+        }
+        return n;
+    }
+}
+
+/**
+ * Receives the reply to a remote cache request into `reply`, giving up at
+ * `deadline`, and appends its body to `response` if it is not NULL. Returns the
+ * HTTP status code, or -1 on failure. Bodies with a transfer coding (chunked)
+ * aren't supported, so such replies are reported as 404, i.e. as misses.
+ */
+static int remote_cache_read_reply(int fd, HglStringBuilder *reply, HglStringBuilder *response, double deadline)
+{
+    /* status line and headers */
+    const char *headers_end = NULL;
+    while (headers_end == NULL) {
+        if (remote_cache_recv(fd, reply, deadline) <= 0) {
+            return -1;
+        }
+        headers_end = memmem(reply->cstr, reply->length, "\r\n\r\n", 4);
+    }
+    size_t body_start = headers_end + 4 - reply->cstr;
+    HglStringView headers = hgl_sv_from(reply->cstr, body_start);
+    if (!hgl_sv_lchop_if_starts_with(&headers, "HTTP/1.")) {
+        return -1;
+    }
+    hgl_sv_lchop_until(&headers, ' ');
+    int status = (int) hgl_sv_lchop_u64(&headers);
+    hgl_sv_lchop_until(&headers, '\n');
+    if (response == NULL) {
+        return status;
+    }
+
+    bool has_length    = false;
+    size_t body_length = 0;
+    while (headers.length > 0) {
+        HglStringView value = hgl_sv_lchop_until(&headers, '\n');
+        HglStringView name  = sv_trim(hgl_sv_lchop_until(&value, ':'));
+        value = sv_trim(value);
+        if (name.length == 14 && strncasecmp(name.start, "Content-Length", 14) == 0) {
+            has_length  = true;
+            body_length = hgl_sv_to_u64(value);
+        } else if (name.length == 17 && strncasecmp(name.start, "Transfer-Encoding", 17) == 0 &&
+                   !(value.length == 8 && strncasecmp(value.start, "identity", 8) == 0)) {
+            return 404;
+        }
+    }
+
+    /* the body ends after Content-Length bytes, or else where the connection is closed */
+    while (!has_length || reply->length - body_start < body_length) {
+        ssize_t n = remote_cache_recv(fd, reply, deadline);
+        if (n == 0 && !has_length) {
+            body_length = reply->length - body_start;
+            break;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+    }
+    hgl_sb_append(response, reply->cstr + body_start, body_length);
+    return status;
+}
+
+/**
+ * Sends a HTTP/1.1 request for `<prefix>/<path>` to the remote cache. The body of
+ * the response is appended to `response` if it is not NULL. The whole request,
+ * from connecting to receiving the last byte, times out after
+ * `--remote-cache-timeout` milliseconds. Returns the HTTP status code, or -1 on
+ * failure.
+ */
+static int remote_cache_request(const char *method, const char *path, const char *body, size_t body_size,
+                                HglStringBuilder *response)
+{
+    double deadline = now_seconds() + 1e-3 * (double) *opt_remote_cache_timeout;
+    int fd = remote_cache_connect(deadline);
+    if (fd == -1) {
+        return -1;
+    }
+
+    HglStringBuilder request = hgl_sb_make(.initial_capacity = 512 + body_size);
+    hgl_sb_append_fmt(&request, "%s %s/%s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                      "Content-Length: %zu\r\n\r\n", method, remote_cache.prefix, path,
+                      remote_cache.host, body_size);
+    hgl_sb_append(&request, body, body_size);
+
+    size_t n_sent = 0;
+    while (n_sent < request.length && remote_cache_wait(fd, POLLOUT, deadline)) {
+        ssize_t n = send(fd, request.cstr + n_sent, request.length - n_sent, MSG_NOSIGNAL);
+        if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        n_sent += n;
+    }
+
+    int status = -1;
+    HglStringBuilder reply = hgl_sb_make(.initial_capacity = 4096);
+    if (n_sent == request.length) {
+        status = remote_cache_read_reply(fd, &reply, response, deadline);
+    }
+
+    hgl_sb_destroy(&request);
+    hgl_sb_destroy(&reply);
+    close(fd);
+    return status;
+}
+
+/**
+ * Looks `key` up in the local cache, then in the remote cache. Entries fetched from
+ * the remote cache are stored in the local cache. On a hit, the cached output is
+ * appended to `result` and true is returned.
+ */
+static bool cache_lookup(const uint8_t key[32], HglStringBuilder *result)
+{
+    char hex[65];
+    hgl_hash_to_hex(key, 32, hex);
+
+    if (*opt_cache_dir != NULL) {
+        char path[4096];
+        local_cache_path(hex, path, sizeof(path));
+        if (read_file(path, result)) {
+            return true;
+        }
+    }
+
+    if (!remote_cache.enabled) {
+        return false;
+    }
+
+    /*
+     * Remote entries are laid out like a Bazel HTTP remote cache: /ac/<key> holds the
+     * SHA-256 of the output, and /cas/<sha256> holds the output itself.
+     */
+    char path[128];
+    HglStringBuilder digest = hgl_sb_make(.initial_capacity = 128);
+    snprintf(path, sizeof(path), "ac/%s", hex);
+    errno = 0;
+    int status = remote_cache_request("GET", path, NULL, 0, &digest);
+    if (status != 200 || digest.length != 64) {
+        if (status != 404) {
+            remote_cache_fail("lookup");
+        }
+        hgl_sb_destroy(&digest);
+        return false;
+    }
+
+    HglStringBuilder blob = hgl_sb_make(.initial_capacity = 4096);
+    snprintf(path, sizeof(path), "cas/%s", digest.cstr);
+    status = remote_cache_request("GET", path, NULL, 0, &blob);
+
+    /* don't trust the server blindly */
+    uint8_t blob_digest[32];
+    char blob_hex[65];
+    hgl_hash_sha256(blob.cstr, blob.length, blob_digest);
+    hgl_hash_to_hex(blob_digest, 32, blob_hex);
+    bool hit = (status == 200) && (strcmp(blob_hex, digest.cstr) == 0);
+    if (hit) {
+        hgl_sb_append(result, blob.cstr, blob.length);
+        if (*opt_cache_dir != NULL) {
+            char local_path[4096];
+            local_cache_path(hex, local_path, sizeof(local_path));
+            write_file_atomic(local_path, blob.cstr, blob.length);
+        }
+    } else if (status != 404) {
+        remote_cache_fail("fetch");
+    }
+
+    hgl_sb_destroy(&digest);
+    hgl_sb_destroy(&blob);
+    return hit;
+}
+
+/**
+ * Stores `size` bytes of `data` under `key` in the local and the remote cache.
+ */
+static void cache_store(const uint8_t key[32], const char *data, size_t size)
+{
+    char hex[65];
+    hgl_hash_to_hex(key, 32, hex);
+
+    if (*opt_cache_dir != NULL) {
+        char path[4096];
+        local_cache_path(hex, path, sizeof(path));
+        if (!write_file_atomic(path, data, size)) {
+            fprintf(stderr, "  WARNING: unable to write cache entry `%s`. errno=%s\n", path, strerror(errno));
+        }
+    }
+
+    if (!remote_cache.enabled) {
+        return;
+    }
+
+    uint8_t digest[32];
+    char digest_hex[65];
+    hgl_hash_sha256(data, size, digest);
+    hgl_hash_to_hex(digest, 32, digest_hex);
+
+    /* the blob goes first, so the action entry never points to a missing blob */
+    char path[128];
+    snprintf(path, sizeof(path), "cas/%s", digest_hex);
+    errno = 0;
+    int status = remote_cache_request("PUT", path, data, size, NULL);
+    if (status >= 200 && status < 300) {
+        snprintf(path, sizeof(path), "ac/%s", hex);
+        status = remote_cache_request("PUT", path, digest_hex, 64, NULL);
+    }
+    if (status < 200 || status >= 300) {
+        remote_cache_fail("upload");
+    }
+}
+
+/**
+ * Adds `path` to the files read by scripts, which are listed by `--depfile`.
+ */
+static void depfile_add(const char *path)
+{
+    for (size_t i = 0; i < n_depfile_inputs; i++) {
+        if (strcmp(depfile_inputs[i], path) == 0) {
+            return;
+        }
+    }
+    depfile_inputs = realloc(depfile_inputs, (n_depfile_inputs + 1) * sizeof(*depfile_inputs));
+    depfile_inputs[n_depfile_inputs++] = strdup(path);
+}
+
+/**
+ * Compares the names of two directory entries, for `qsort`.
+ */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/**
+ * Writes the fingerprint of the traced input `path` to `fp`: `-` if it doesn't
+ * exist, else its type (`f`ile, `d`irectory or `o`ther) followed, if `contents`
+ * was read, by the SHA-256 of its contents (of its sorted entry names, for a
+ * directory) in hex.
+ */
+static void trace_fingerprint(const char *path, bool contents, char fp[66])
+{
+    struct stat sb;
+    if (stat(path, &sb) != 0) {
+        strcpy(fp, "-");
+        return;
+    }
+    fp[0] = S_ISREG(sb.st_mode) ? 'f' : S_ISDIR(sb.st_mode) ? 'd' : 'o';
+    fp[1] = '\0';
+    if (!contents || fp[0] == 'o') {
+        return;
+    }
+
+    uint8_t digest[32];
+    if (fp[0] == 'f') {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        void *data = (fd == -1 || sb.st_size == 0) ? NULL :
+                     mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (fd == -1 || data == MAP_FAILED) {
+            fp[0] = 'o'; /* unreadable */
+        } else {
+            hgl_hash_sha256(data, (data == NULL) ? 0 : (size_t) sb.st_size, digest);
+        }
+        if (data != NULL && data != MAP_FAILED) {
+            munmap(data, sb.st_size);
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+    } else {
+        DIR *dir = opendir(path);
+        char **names = NULL;
+        size_t n_names = 0;
+        struct dirent *entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            names = realloc(names, (n_names + 1) * sizeof(*names));
+            names[n_names++] = strdup(entry->d_name);
+        }
+        if (dir == NULL) {
+            fp[0] = 'o'; /* unreadable */
+        } else {
+            closedir(dir);
+        }
+        if (n_names > 0) {
+            qsort(names, n_names, sizeof(*names), compare_names);
+        }
+        HglSha256 ctx;
+        hgl_hash_sha256_init(&ctx);
+        for (size_t i = 0; i < n_names; i++) {
+            hgl_hash_sha256_update(&ctx, names[i], strlen(names[i]) + 1);
+            free(names[i]);
+        }
+        hgl_hash_sha256_final(&ctx, digest);
+        free(names);
+    }
+    if (fp[0] != 'o') {
+        hgl_hash_to_hex(digest, 32, fp + 1);
+    }
+}
+
+/**
+ * Appends the input manifest of the traced script of `job` to `sb`: a header line
+ * followed by one `<c|s> <fingerprint> <path>` line per input (`c` if its contents
+ * were read, `s` if it was only stat'ed) and an empty line. With `--trace-inputs`,
+ * cache entries start with the manifest of the script.
+ */
+static void trace_manifest_append(ScriptJob *job, HglStringBuilder *sb)
+{
+    hgl_sb_append_cstr(sb, "gept-inputs-v1\n");
+    for (size_t i = 0; i < job->n_inputs; i++) {
+        char fp[66];
+        trace_fingerprint(job->inputs[i].path, job->inputs[i].contents, fp);
+        hgl_sb_append_fmt(sb, "%c %s %s\n", job->inputs[i].contents ? 'c' : 's', fp, job->inputs[i].path);
+    }
+    hgl_sb_append_cstr(sb, "\n");
+}
+
+/**
+ * Checks the manifest at the start of the cache entry `entry` of a traced script
+ * against the file system. If every input still has the recorded fingerprint, the
+ * manifest is removed, leaving the cached output, the inputs are added to the
+ * depfile and true is returned. Else the entry is stale and the script must run.
+ */
+static bool trace_manifest_check(HglStringBuilder *entry)
+{
+    HglStringView manifest = hgl_sv_from_sb(entry);
+    if (!hgl_sv_lchop_if_starts_with(&manifest, "gept-inputs-v1\n")) {
+        return false;
+    }
+
+    HglStringView lines = manifest;
+    for (;;) {
+        if (lines.length == 0) {
+            return false; /* truncated */
+        }
+        HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+        if (line.length == 0) {
+            break;
+        }
+        char path[PATH_MAX];
+        char fp[66];
+        HglStringView kind     = hgl_sv_lchop_until(&line, ' ');
+        HglStringView expected = hgl_sv_lchop_until(&line, ' ');
+        if (kind.length != 1 || line.length == 0 || line.length >= sizeof(path)) {
+            return false;
+        }
+        memcpy(path, line.start, line.length);
+        path[line.length] = '\0';
+        trace_fingerprint(path, kind.start[0] == 'c', fp);
+        if (!hgl_sv_equals(expected, hgl_sv_from_cstr(fp))) {
+            return false;
+        }
+    }
+
+    for (HglStringView deps = manifest; deps.length > 0;) {
+        HglStringView line = hgl_sv_lchop_until(&deps, '\n');
+        if (line.length == 0) {
+            break;
+        }
+        char path[PATH_MAX];
+        hgl_sv_lchop_until(&line, ' ');
+        hgl_sv_lchop_until(&line, ' ');
+        memcpy(path, line.start, line.length);
+        path[line.length] = '\0';
+        depfile_add(path);
+    }
+
+    size_t offset = lines.start - entry->cstr;
+    memmove(entry->cstr, entry->cstr + offset, entry->length - offset);
+    entry->length -= offset;
+    entry->cstr[entry->length] = '\0';
+    return true;
+}
+
+/**
+ * Returns true if the output of `job` is spliced into `sb` for `variant`: the job
+ * targets `sb` and is shared by all variants or runs for `variant`.
+ */
+static bool job_targets(const ScriptJob *job, const HglStringBuilder *sb, size_t variant)
+{
+    return job->sink == sb && (job->variant == SIZE_MAX || job->variant == variant);
+}
+
+/**
+ * Returns the output of `job`, which is that of the job it reuses if any.
+ */
+static const HglStringBuilder *job_result(const ScriptJob *job)
+{
+    return (job->same_as != NULL) ? &job->same_as->result : &job->result;
+}
+
+/**
+ * Appends `sb` to `spliced`, with the output of all scripts targeting `sb` for
+ * `variant` spliced in at the offsets where the scripts appeared in the template.
+ */
+static void jobs_splice_to(const HglStringBuilder *sb, size_t variant, HglStringBuilder *spliced)
+{
+    size_t prev_offset = 0;
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (!job_targets(jobs[i], sb, variant)) {
+            continue;
+        }
+        const HglStringBuilder *result = job_result(jobs[i]);
+        hgl_sb_append(spliced, sb->cstr + prev_offset, jobs[i]->offset - prev_offset);
+        hgl_sb_append(spliced, result->cstr, result->length);
+        prev_offset = jobs[i]->offset;
+    }
+    hgl_sb_append(spliced, sb->cstr + prev_offset, sb->length - prev_offset);
+}
+
+/**
+ * Splices the output of all scripts targeting `sb` into it, at the offsets where
+ * the scripts appeared in the template.
+ */
+static void jobs_splice(HglStringBuilder *sb)
+{
+    size_t total = sb->length;
+    bool has_jobs = false;
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (jobs[i]->sink == sb) {
+            total += job_result(jobs[i])->length;
+            has_jobs = true;
+        }
+    }
+    if (!has_jobs) {
+        return;
+    }
+
+    HglStringBuilder spliced = hgl_sb_make(.initial_capacity = total + 1);
+    jobs_splice_to(sb, SIZE_MAX, &spliced);
+    hgl_sb_destroy(sb);
+    *sb = spliced;
+}
+
+/**
+ * Frees all script jobs.
+ */
+static void jobs_release(void)
+{
+    for (size_t i = 0; i < n_jobs; i++) {
+        hgl_sb_destroy(&jobs[i]->result);
+        if (jobs[i]->expanded_from.mem_free != NULL) {
+            hgl_sb_destroy(&jobs[i]->expanded_from);
+        }
+        if (jobs[i]->source.mem_free != NULL) {
+            hgl_sb_destroy(&jobs[i]->source);
+        }
+        for (size_t j = 0; j < jobs[i]->n_inputs; j++) {
+            free(jobs[i]->inputs[j].path);
+        }
+        free(jobs[i]->inputs);
+        free(jobs[i]);
+    }
+    free(jobs);
+    jobs   = NULL;
+    n_jobs = 0;
+}
+
+/**
+ * Expands a @hash directive: appends the hash of the file at `path`, computed with
+ * `algo(crc32c|xxh64|sha256)` (default sha256), as bare lowercase hex (`fmt(hex)`,
+ * default), a C string literal (`fmt(str)`) or an integer literal (`fmt(int)`, not
+ * for sha256).
+ */
+static void expand_hash(HglStringView line, HglStringBuilder *output, const char *path, HglStringView tokens)
+{
+    HglStringView algo = HGL_SV_LIT("sha256");
+    HglStringView fmt  = HGL_SV_LIT("hex");
+
+    Attribute attr;
+    while (parse_attribute(line, &tokens, &attr)) {
+        GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected a single argument to `"HGL_SV_FMT"`\n",
+                         HGL_SV_ARG(attr.name));
+        if (hgl_sv_equals(attr.name, HGL_SV_LIT("algo"))) {
+            algo = attr.args[0];
+        } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("fmt"))) {
+            fmt = attr.args[0];
+        } else {
+            GEPT_ASSERT_LINE(line, false, "Unknown attribute `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr.name));
+        }
+    }
+
+    MappedFile *mf = mapped_file_get(path);
+    GEPT_ASSERT_LINE(line, mf != NULL, "Unable to open file `%s`\n", path);
+
+    uint8_t digest[32];
+    size_t digest_size;
+    if (hgl_sv_equals(algo, HGL_SV_LIT("sha256"))) {
+        hgl_hash_sha256(mf->data, mf->size, digest);
+        digest_size = 32;
+    } else if (hgl_sv_equals(algo, HGL_SV_LIT("xxh64"))) {
+        uint64_t h = hgl_hash_xxh64(mf->data, mf->size, 0);
+        for (int i = 0; i < 8; i++) digest[i] = (uint8_t) (h >> (56 - 8*i));
+        digest_size = 8;
+    } else if (hgl_sv_equals(algo, HGL_SV_LIT("crc32c"))) {
+        uint32_t h = hgl_hash_crc32c(mf->data, mf->size, 0);
+        for (int i = 0; i < 4; i++) digest[i] = (uint8_t) (h >> (24 - 8*i));
+        digest_size = 4;
+    } else {
+        GEPT_ASSERT_LINE(line, false, "Unknown hash algorithm `"HGL_SV_FMT"`. Expected crc32c, xxh64 or sha256\n",
+                         HGL_SV_ARG(algo));
+    }
+
+    char hex[65];
+    hgl_hash_to_hex(digest, digest_size, hex);
+
+    if (hgl_sv_equals(fmt, HGL_SV_LIT("hex"))) {
+        hgl_sb_append_fmt(output, "    %s\n", hex);
+    } else if (hgl_sv_equals(fmt, HGL_SV_LIT("str"))) {
+        hgl_sb_append_fmt(output, "    \"%s\"\n", hex);
+    } else if (hgl_sv_equals(fmt, HGL_SV_LIT("int"))) {
+        GEPT_ASSERT_LINE(line, digest_size <= 8, "fmt(int) is not supported for sha256\n");
+        hgl_sb_append_fmt(output, "    0x%s%s\n", hex, (digest_size == 8) ? "ULL" : "U");
+    } else {
+        GEPT_ASSERT_LINE(line, false, "Unknown format `"HGL_SV_FMT"`. Expected hex, str or int\n", HGL_SV_ARG(fmt));
+    }
+}
+
+/*--- plugin API ------------------------------------------------------------------------*/
+
+static int plugin_register_directive(const GeptApi *api, const GeptDirective *directive)
+{
+    (void) api;
+    if (directive->name == NULL || directive->name[0] != '@' || directive->expand == NULL) {
+        fprintf(stderr, "  ERROR: Plugin directives need a name starting with `@` and an expand callback\n");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(builtin_directives) / sizeof(builtin_directives[0]); i++) {
+        if (strcmp(directive->name, builtin_directives[i]) == 0) {
+            fprintf(stderr, "  ERROR: Plugin directive `%s` shadows a built-in directive\n", directive->name);
+            return 1;
+        }
+    }
+    if (interpreter_find(hgl_sv_from_cstr(directive->name)) != NULL) {
+        fprintf(stderr, "  ERROR: Plugin directive `%s` shadows an interpreter\n", directive->name);
+        return 1;
+    }
+    for (size_t i = 0; i < n_plugin_directives; i++) {
+        if (strcmp(directive->name, plugin_directives[i]->name) == 0) {
+            fprintf(stderr, "  ERROR: Plugin directive `%s` is registered twice\n", directive->name);
+            return 1;
+        }
+    }
+
+    plugin_directives = realloc(plugin_directives, (n_plugin_directives + 1) * sizeof(*plugin_directives));
+    plugin_directives[n_plugin_directives++] = directive;
+    return 0;
+}
+
+static bool plugin_next_word(GeptCall *call, const char **word, size_t *length)
+{
+    HglStringView args = hgl_sv_ltrim(hgl_sv_from(call->args, call->args_length));
+    HglStringView sv = hgl_sv_lchop_until(&args, ' ');
+    call->args = args.start;
+    call->args_length = args.length;
+    *word = sv.start;
+    *length = sv.length;
+    return sv.length > 0;
+}
+
+static bool plugin_next_attribute(GeptCall *call, GeptAttribute *attr)
+{
+    HglStringView line = hgl_sv_from(call->line, call->line_length);
+    HglStringView args = hgl_sv_from(call->args, call->args_length);
+    Attribute a;
+    bool ok = parse_attribute(line, &args, &a);
+    call->args = args.start;
+    call->args_length = args.length;
+    if (!ok) {
+        return false;
+    }
+
+    attr->name = a.name.start;
+    attr->name_length = a.name.length;
+    attr->n_args = a.n_args;
+    for (int i = 0; i < a.n_args; i++) {
+        attr->args[i] = a.args[i].start;
+        attr->args_length[i] = a.args[i].length;
+    }
+    return true;
+}
+
+static bool plugin_map_file(const char *path, const char **data, size_t *size)
+{
+    MappedFile *mf = mapped_file_get(path);
+    if (mf == NULL) {
+        return false;
+    }
+    *data = mf->data;
+    *size = mf->size;
+    return true;
+}
+
+static void plugin_append(GeptSink *sink, const char *data, size_t size)
+{
+    hgl_sb_append((HglStringBuilder *) sink, data, size);
+}
+
+__attribute__((format(printf, 2, 3)))
+static void plugin_append_fmt(GeptSink *sink, const char *fmt, ...)
+{
+    HglStringBuilder *sb = (HglStringBuilder *) sink;
+    va_list args;
+    va_start(args, fmt);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int n = vsnprintf(NULL, 0, fmt, args_copy);
+    va_end(args_copy);
+    if (n > 0) {
+        hgl_sb_grow_by_policy(sb, sb->length + n + 1, HGL_SB_DEFAULT_GROWTH_POLICY);
+        vsnprintf(sb->cstr + sb->length, n + 1, fmt, args);
+        sb->length += n;
+    }
+    va_end(args);
+}
+
+static void plugin_append_embed(GeptSink *sink, const uint8_t *data, size_t size)
+{
+    append_embed((HglStringBuilder *) sink, data, size);
+}
+
+static void plugin_append_c_string(GeptSink *sink, const char *data, size_t size)
+{
+    append_c_string((HglStringBuilder *) sink, data, size);
+}
+
+static const GeptApi plugin_api = {
+    .abi_version        = GEPT_PLUGIN_ABI_VERSION,
+    .register_directive = plugin_register_directive,
+    .next_word          = plugin_next_word,
+    .next_attribute     = plugin_next_attribute,
+    .map_file           = plugin_map_file,
+    .append             = plugin_append,
+    .append_fmt         = plugin_append_fmt,
+    .append_embed       = plugin_append_embed,
+    .append_c_string    = plugin_append_c_string,
+    .sha256             = hgl_hash_sha256,
+};
+
+/**
+ * Loads the plugins in `paths` (a comma-separated list of shared objects) and runs
+ * their init functions.
+ */
+static void plugins_load(const char *paths)
+{
+    HglStringView list = hgl_sv_from_cstr(paths);
+    while (list.length > 0) {
+        HglStringView path = sv_trim(hgl_sv_lchop_until(&list, ','));
+        if (path.length == 0) {
+            continue;
+        }
+
+        char cpath[4096];
+        GEPT_ASSERT(path.length < sizeof(cpath), "Plugin path is too long\n");
+        memcpy(cpath, path.start, path.length);
+        cpath[path.length] = '\0';
+
+        void *handle = dlopen(cpath, RTLD_NOW | RTLD_LOCAL);
+        GEPT_ASSERT(handle != NULL, "Unable to load plugin `%s`: %s\n", cpath, dlerror());
+        const uint32_t *abi_version = dlsym(handle, "gept_plugin_abi_version");
+        int (*init)(const GeptApi *);
+        *(void **) &init = dlsym(handle, "gept_plugin_init");
+        GEPT_ASSERT(abi_version != NULL && init != NULL,
+                    "`%s` is not a GEPT plugin (gept_plugin_abi_version or gept_plugin_init is missing)\n", cpath);
+        GEPT_ASSERT((*abi_version >> 16) == GEPT_PLUGIN_ABI_MAJOR && (*abi_version & 0xFFFF) <= GEPT_PLUGIN_ABI_MINOR,
+                    "Plugin `%s` was built for ABI version %u.%u, but GEPT supports %u.%u\n", cpath,
+                    *abi_version >> 16, *abi_version & 0xFFFF, GEPT_PLUGIN_ABI_MAJOR, GEPT_PLUGIN_ABI_MINOR);
+        GEPT_ASSERT(init(&plugin_api) == 0, "Initialization of plugin `%s` failed\n", cpath);
+
+        plugin_handles = realloc(plugin_handles, (n_plugin_handles + 1) * sizeof(*plugin_handles));
+        plugin_handles[n_plugin_handles++] = handle;
+    }
+}
+
+/**
+ * Returns the plugin directive named `name`, or NULL.
+ */
+static const GeptDirective *plugin_directive_find(HglStringView name)
+{
+    for (size_t i = 0; i < n_plugin_directives; i++) {
+        if (hgl_sv_equals_cstr(name, plugin_directives[i]->name)) {
+            return plugin_directives[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Unloads all plugins.
+ */
+static void plugins_release(void)
+{
+    for (size_t i = 0; i < n_plugin_handles; i++) {
+        dlclose(plugin_handles[i]);
+    }
+    free(plugin_handles);
+    free(plugin_directives);
+    plugin_handles      = NULL;
+    plugin_directives   = NULL;
+    n_plugin_handles    = 0;
+    n_plugin_directives = 0;
+}
+
+/**
+ * Returns the hash which identifies the script `source_code` run by `interpreter`
+ * in histories.
+ */
+static uint64_t script_block_hash(const Interpreter *interpreter, HglStringBuilder *source_code)
+{
+    uint64_t seed = hgl_hash_xxh64(interpreter->directive, strlen(interpreter->directive), 0);
+    return hgl_hash_xxh64(source_code->cstr, source_code->length, seed);
+}
+
+/**
+ * Runs the script `source_code` of the directive at `line` with `interpreter`, for
+ * `variant` (SIZE_MAX if shared by all variants). Its output is spliced into `out`
+ * at the current end, or taken from the cache. Ownership of `source_code` passes to
+ * the job with `--compile`.
+ */
+static ScriptJob *script_run(HglStringView line, HglStringBuilder *out, Interpreter *interpreter,
+                             HglStringBuilder *source_code, size_t variant)
+{
+    /*
+     * Compiled generators run the script themselves, with the NAME=VALUE
+     * arguments of the generator in its environment. Output cached without
+     * them doesn't apply.
+     */
+    if (*opt_compile != NULL) {
+        ScriptJob *job = job_add(line, out);
+        job->interpreter = interpreter;
+        job->source      = *source_code;
+        job->done        = true;
+        return job;
+    }
+
+    /*
+     * Skip running the script if its output is cached. Cached output is
+     * spliced in like the output of a script, so it can be re-expanded.
+     */
+    uint8_t cache_key[32];
+    bool is_cacheable = (*opt_cache_dir != NULL || remote_cache.enabled);
+    if (is_cacheable) {
+        script_cache_key(interpreter, source_code, variant, cache_key);
+        HglStringBuilder cached = hgl_sb_make(.initial_capacity = 4096);
+        if (cache_lookup(cache_key, &cached) && (!*opt_trace_inputs || trace_manifest_check(&cached))) {
+            ScriptJob *job = job_add(line, out);
+            hgl_sb_destroy(&job->result);
+            job->result      = cached;
+            job->interpreter = interpreter;
+            job->variant     = variant;
+            job->block_hash  = script_block_hash(interpreter, source_code);
+            job->done        = true;
+            history_expect(job); /* keeps the block in the history */
+            return job;
+        }
+        hgl_sb_destroy(&cached);
+    }
+
+    ScriptJob *job = job_add(line, out);
+    job->interpreter  = interpreter;
+    job->variant      = variant;
+    job->block_hash   = script_block_hash(interpreter, source_code);
+    job->is_cacheable = is_cacheable;
+    memcpy(job->cache_key, cache_key, sizeof(cache_key));
+    if (max_jobs == 1) {
+        script_spawn(job, source_code, jobs_wait_for_slot());
+        jobs_wait_all();
+        return job;
+    }
+
+    /*
+     * Scripts run in the background while the rest of the template is
+     * expanded, and are started as soon as there is a free slot. When the
+     * history can tell which of them are slow, they are started once the
+     * template has been expanded instead, so `jobs_dispatch` can start the
+     * longest first. Their output is spliced in once all of them are done.
+     */
+    job->source           = hgl_sb_make_copy(source_code);
+    job->is_pending       = true;
+    job->expected_seconds = history_expect(job);
+    n_pending_jobs++;
+    if (!history_is_sortable(job)) {
+        jobs_dispatch(false);
+    }
+    return job;
+}
+
+/**
+ * Runs the script `source_code` once for every variant. Variants the script has
+ * the same cache key for, i.e. which have the same defines, share one run.
+ */
+static void script_run_variants(HglStringView line, HglStringBuilder *out, Interpreter *interpreter,
+                                HglStringBuilder *source_code)
+{
+    uint8_t (*keys)[32] = malloc(n_variants * sizeof(*keys));
+    ScriptJob **runs = malloc(n_variants * sizeof(*runs));
+    for (size_t i = 0; i < n_variants; i++) {
+        script_cache_key(interpreter, source_code, i, keys[i]);
+        size_t k = 0;
+        while (k < i && memcmp(keys[k], keys[i], sizeof(keys[i])) != 0) {
+            k++;
+        }
+        if (k == i) {
+            runs[i] = script_run(line, out, interpreter, source_code, i);
+            continue;
+        }
+        runs[i] = job_add(line, out);
+        runs[i]->variant = i;
+        runs[i]->same_as = runs[k];
+        runs[i]->done    = true;
+    }
+    free(runs);
+    free(keys);
+}
+
+/**
+ * Expands the template `input` into `output`. Scripts are started (or queued for
+ * `jobs_dispatch`) but not waited for; their output is spliced in by `jobs_splice`
+ * once `jobs_wait_all` returns.
+ */
+static void expand_template(HglStringView input, HglStringBuilder *output)
+{
+    int err;
+    HglStringView line;
+    HglStringView tokens;
+    HglStringBuilder *out = output;
+    OutputSink *sink_stack[MAX_OUTPUT_DEPTH];
+    int sink_depth = 0;
+
+    while (input.length > 0) {
+
+        /* regular code ==> append the lines up to the next directive to output in one go */
+        HglSlice rest = hgl_slice_from_sv(input);
+        while (rest.len > 0) {
+            HglSlice after = rest;
+            if (hgl_slice_starts_with_char(hgl_slice_ltrim(hgl_slice_lchop_until(&after, '\n')), '@')) {
+                break;
+            }
+            rest = after;
+        }
+        size_t n_regular = rest.ptr - input.start;
+        if (n_regular > 0) {
+            hgl_sb_append(out, input.start, n_regular);
+            if (input.start[n_regular - 1] != '\n') {
+                hgl_sb_append_char(out, '\n'); /* last line of the input */
+            }
+            input = hgl_slice_to_sv(rest);
+            continue;
+        }
+
+        /* get next line, which holds a directive */
+        line = hgl_sv_lchop_until(&input, '\n');
+        tokens = hgl_sv_ltrim(line);
+
+        HglStringView directive = hgl_sv_lchop_until(&tokens, ' ');
+
+        /* @output directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@output"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length > 0, "Expected a path\n");
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            /* route everything up to the matching @end to the sink of `path` */
+            GEPT_ASSERT_LINE(line, sink_depth < MAX_OUTPUT_DEPTH, "@output directives are nested too deeply\n");
+            sink_stack[sink_depth++] = output_sink_get((char *) scratch_buf);
+            out = &sink_stack[sink_depth - 1]->sb;
+        }
+
+        /* plugin directives */
+        const GeptDirective *plugin_directive = plugin_directive_find(directive);
+        if (plugin_directive != NULL) {
+            HglStringBuilder body = {0};
+            if (plugin_directive->is_multiline) {
+                body = read_block(&input, directive);
+            }
+            GeptCall call = {
+                .line        = line.start,
+                .line_length = line.length,
+                .args        = tokens.start,
+                .args_length = tokens.length,
+                .body        = body.cstr,
+                .body_length = body.length,
+                .user_data   = plugin_directive->user_data,
+            };
+            err = plugin_directive->expand(&plugin_api, &call, (GeptSink *) out);
+            GEPT_ASSERT_LINE(line, err == 0, "Plugin directive `%s` failed\n", plugin_directive->name);
+            if (plugin_directive->is_multiline) {
+                hgl_sb_destroy(&body);
+            }
+            continue;
+        }
+
+        /* end of @output directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@end"))) {
+            GEPT_ASSERT_LINE(line, sink_depth > 0, "@end without a matching @output\n");
+            sink_depth--;
+            out = (sink_depth > 0) ? &sink_stack[sink_depth - 1]->sb : output;
+        }
+
+        /* @hash directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@hash"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            expand_hash(line, out, (char *) scratch_buf, tokens);
+        }
+
+        /* @lut directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@lut"))) {
+            HglStringView generator = hgl_sv_lchop_until(&tokens, ' ');
+            expand_lut(line, out, generator, tokens);
+        }
+
+        /* @sizeof, @mtime, @mode and @inode directives */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@sizeof")) ||
+            hgl_sv_equals(directive, HGL_SV_LIT("@mtime")) ||
+            hgl_sv_equals(directive, HGL_SV_LIT("@mode")) ||
+            hgl_sv_equals(directive, HGL_SV_LIT("@inode"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            FileStat *fs = file_stat_get((char *) scratch_buf);
+            GEPT_ASSERT_LINE(line, fs != NULL, "Unable to stat file `%s`. errno=%s\n", scratch_buf, strerror(errno));
+
+            /* append metadata to output */
+            if (hgl_sv_equals(directive, HGL_SV_LIT("@sizeof"))) {
+                hgl_sb_append_fmt(out, "    %llu", (unsigned long long) fs->size);
+            } else if (hgl_sv_equals(directive, HGL_SV_LIT("@mtime"))) {
+                hgl_sb_append_fmt(out, "    %lld", (long long) fs->mtime);
+            } else if (hgl_sv_equals(directive, HGL_SV_LIT("@mode"))) {
+                hgl_sb_append_fmt(out, "    0%o", (unsigned) fs->mode);
+            } else {
+                hgl_sb_append_fmt(out, "    %llu", (unsigned long long) fs->inode);
+            }
+
+            /* append remaining line to output */
+            hgl_sb_append_char(out, ' ');
+            hgl_sb_append_sv(out, &tokens);
+            hgl_sb_append_char(out, '\n');
+        }
+
+        /* @embed directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@embed"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            /* has limit(n), extern(name), source(path), shared(name) and/or decompress(gzip) ? */
+            Attribute attr;
+            size_t limit = SCRATCH_BUFFER_SIZE;
+            HglStringView extern_name = {0};
+            HglStringView source_path = {0};
+            HglStringView shared_name = {0};
+            bool is_gzip = false;
+            while (parse_attribute(line, &tokens, &attr)) {
+                GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected a single argument to `"HGL_SV_FMT"`\n",
+                                 HGL_SV_ARG(attr.name));
+                if (hgl_sv_equals(attr.name, HGL_SV_LIT("limit"))) {
+                    limit = hgl_sv_to_u64(attr.args[0]);
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("extern"))) {
+                    extern_name = attr.args[0];
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("source"))) {
+                    source_path = attr.args[0];
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("shared"))) {
+                    shared_name = attr.args[0];
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("decompress"))) {
+                    parse_decompress(line, &attr);
+                    is_gzip = true;
+                } else {
+                    GEPT_ASSERT_LINE(line, false, "Unknown attribute `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr.name));
+                }
+            }
+
+            GEPT_ASSERT_LINE(line, shared_name.length == 0 || (extern_name.length == 0 && source_path.length == 0),
+                             "shared(NAME) can't be combined with extern(NAME) or source(PATH)\n");
+            if (is_gzip) {
+                /* inline, decompressed chunks go straight into the encoder */
+                MappedFile *mf = mapped_file_get((char *) scratch_buf);
+                GEPT_ASSERT_LINE(line, mf != NULL, "Unable to open file `%s`\n", scratch_buf);
+                if (extern_name.length == 0 && source_path.length == 0 && shared_name.length == 0) {
+                    append_gunzip(line, out, mf, limit, true);
+                } else {
+                    /* extern and shared arrays are declared with their size, before their data */
+                    HglStringBuilder data = hgl_sb_make(.initial_capacity = 4096);
+                    append_gunzip(line, &data, mf, limit, false);
+                    if (shared_name.length > 0) {
+                        append_embed_shared(line, out, (const uint8_t *) data.cstr, data.length, shared_name);
+                    } else {
+                        append_embed_site(line, out, (const uint8_t *) data.cstr, data.length,
+                                          extern_name, source_path);
+                    }
+                    hgl_sb_destroy(&data);
+                }
+            } else {
+                /*
+                 * Open file. Regular files are mapped. Device files such as /dev/urandom may
+                 * never reach EOF, so at most `limit` bytes are read from them.
+                 */
+                struct stat sb;
+                GEPT_ASSERT_LINE(line, stat((char *) scratch_buf, &sb) == 0, "Unable to open file `%s`\n", scratch_buf);
+                const uint8_t *data = scratch_buf;
+                size_t size = 0;
+                if (S_ISREG(sb.st_mode)) {
+                    MappedFile *mf = mapped_file_get((char *) scratch_buf);
+                    GEPT_ASSERT_LINE(line, mf != NULL, "Unable to open file `%s`\n", scratch_buf);
+                    data = (const uint8_t *) mf->data;
+                    size = (mf->size < limit) ? mf->size : limit;
+                } else {
+                    int fd = open((char *) scratch_buf, O_RDONLY);
+                    GEPT_ASSERT_LINE(line, fd != -1, "Unable to open file `%s`\n", scratch_buf);
+                    limit = (limit < SCRATCH_BUFFER_SIZE) ? limit : SCRATCH_BUFFER_SIZE;
+                    ssize_t n;
+                    while (size < limit && (n = read(fd, scratch_buf + size, limit - size)) > 0) {
+                        size += n;
+                    }
+                    close(fd);
+                }
+
+                if (shared_name.length > 0) {
+                    append_embed_shared(line, out, data, size, shared_name);
+                } else {
+                    append_embed_site(line, out, data, size, extern_name, source_path);
+                }
+            }
+        }
+
+        /* @random directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@random"))) {
+            expand_random(line, out, tokens);
+        }
+
+        /* @lines directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@lines"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            /* has count(MACRO) ? */
+            Attribute attr;
+            HglStringView count_name = {0};
+            while (parse_attribute(line, &tokens, &attr)) {
+                GEPT_ASSERT_LINE(line, hgl_sv_equals(attr.name, HGL_SV_LIT("count")) && attr.n_args == 1,
+                                 "Unknown attribute `"HGL_SV_FMT"`. Expected count(MACRO)\n", HGL_SV_ARG(attr.name));
+                count_name = attr.args[0];
+            }
+
+            MappedFile *mf = mapped_file_get((char *) scratch_buf);
+            GEPT_ASSERT_LINE(line, mf != NULL, "Unable to open file `%s`\n", scratch_buf);
+            append_lines(out, mf, count_name);
+        }
+
+        /* @include directive */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@include"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            /* open file */
+            MappedFile *mf = mapped_file_get((char *) scratch_buf);
+            GEPT_ASSERT_LINE(line, mf != NULL, "Unable to open file `%s`\n", scratch_buf);
+
+            /* with decompress(gzip), all other attributes apply to the decompressed file */
+            Attribute attr;
+            HglStringView scan = tokens;
+            bool is_gzip = false;
+            int n_other_attributes = 0;
+            while (parse_attribute(line, &scan, &attr)) {
+                if (hgl_sv_equals(attr.name, HGL_SV_LIT("decompress"))) {
+                    parse_decompress(line, &attr);
+                    is_gzip = true;
+                } else {
+                    n_other_attributes++;
+                }
+            }
+            if (is_gzip && n_other_attributes == 0) {
+                append_gunzip(line, out, mf, SIZE_MAX, false);
+                continue;
+            }
+            MappedFile gunzipped = {0};
+            if (is_gzip) {
+                HglStringBuilder data = hgl_sb_make(.initial_capacity = 4096);
+                append_gunzip(line, &data, mf, SIZE_MAX, false);
+                gunzipped = (MappedFile) {.path = mf->path, .data = data.cstr, .size = data.length};
+                mf = &gunzipped;
+            }
+            HglStringView content = hgl_sv_from(mf->data, mf->size);
+
+            /* has lines(A,B) or section(BEGIN, END) and/or any filters? */
+            Filter filters[MAX_FILTERS];
+            int n_filters = 0;
+            bool has_selector = false;
+            while (parse_attribute(line, &tokens, &attr)) {
+                bool is_filter = hgl_sv_equals(attr.name, HGL_SV_LIT("filter")) ||
+                                 hgl_sv_equals(attr.name, HGL_SV_LIT("exclude")) ||
+                                 hgl_sv_equals(attr.name, HGL_SV_LIT("replace")) ||
+                                 hgl_sv_equals(attr.name, HGL_SV_LIT("strip-comments"));
+                GEPT_ASSERT_LINE(line, !is_filter || n_filters < MAX_FILTERS, "Too many filters\n");
+                Filter *f = &filters[n_filters];
+
+                if (hgl_sv_equals(attr.name, HGL_SV_LIT("filter"))) {
+                    GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `filter(REGEX)`\n");
+                    *f = (Filter) {.kind = FILTER_MATCH, .re = regex_get(line, attr.args[0])};
+                    n_filters++;
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("exclude"))) {
+                    GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `exclude(REGEX)`\n");
+                    *f = (Filter) {.kind = FILTER_EXCLUDE, .re = regex_get(line, attr.args[0])};
+                    n_filters++;
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("replace"))) {
+                    GEPT_ASSERT_LINE(line, attr.n_args == 2, "Expected `replace(REGEX, REPLACEMENT)`\n");
+                    *f = (Filter) {.kind = FILTER_REPLACE, .re = regex_get(line, attr.args[0]),
+                                   .replacement = attr.args[1]};
+                    n_filters++;
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("strip-comments"))) {
+                    GEPT_ASSERT_LINE(line, attr.n_args == 1, "Expected `strip-comments(c|sh)`\n");
+                    *f = (Filter) {.kind = FILTER_STRIP_COMMENTS};
+                    if (hgl_sv_equals(attr.args[0], HGL_SV_LIT("c"))) {
+                        f->comment_style = COMMENT_STYLE_C;
+                    } else if (hgl_sv_equals(attr.args[0], HGL_SV_LIT("sh"))) {
+                        f->comment_style = COMMENT_STYLE_SH;
+                    } else {
+                        GEPT_ASSERT_LINE(line, false, "Unknown comment style `"HGL_SV_FMT"`. Expected c or sh\n",
+                                         HGL_SV_ARG(attr.args[0]));
+                    }
+                    n_filters++;
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("lines"))) {
+                    GEPT_ASSERT_LINE(line, !has_selector, "Only one of lines(..) and section(..) may be used\n");
+                    GEPT_ASSERT_LINE(line, attr.n_args == 2, "Expected `lines(FIRST, LAST)`\n");
+                    uint64_t first = hgl_sv_to_u64(attr.args[0]);
+                    uint64_t last  = hgl_sv_equals(attr.args[1], HGL_SV_LIT("$"))
+                                   ? UINT64_MAX : hgl_sv_to_u64(attr.args[1]);
+                    GEPT_ASSERT_LINE(line, first >= 1 && first <= last,
+                                     "Invalid line range. Lines are numbered from 1 and FIRST <= LAST\n");
+                    content = mapped_file_lines(mf, first - 1, last);
+                    has_selector = true;
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("decompress"))) {
+                    /* handled above */
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("section"))) {
+                    GEPT_ASSERT_LINE(line, !has_selector, "Only one of lines(..) and section(..) may be used\n");
+                    GEPT_ASSERT_LINE(line, attr.n_args == 2, "Expected `section(BEGIN_MARKER, END_MARKER)`\n");
+                    GEPT_ASSERT_LINE(line, attr.args[0].length > 0 && attr.args[1].length > 0,
+                                     "Markers of `section(BEGIN_MARKER, END_MARKER)` can't be empty\n");
+                    const char *begin = find_marker(mf->data, mf->size,
+                                                    attr.args[0].start, attr.args[0].length);
+                    GEPT_ASSERT_LINE(line, begin != NULL, "Marker \""HGL_SV_FMT"\" not found in `%s`\n",
+                                     HGL_SV_ARG(attr.args[0]), mf->path);
+                    size_t first = mapped_file_line_of(mf, begin - mf->data) + 1;
+                    size_t from  = (first < mf->n_lines) ? mf->line_offsets[first] : mf->size;
+                    const char *end = find_marker(mf->data + from, mf->size - from,
+                                                  attr.args[1].start, attr.args[1].length);
+                    GEPT_ASSERT_LINE(line, end != NULL, "Marker \""HGL_SV_FMT"\" not found in `%s`\n",
+                                     HGL_SV_ARG(attr.args[1]), mf->path);
+                    content = mapped_file_lines(mf, first, mapped_file_line_of(mf, end - mf->data));
+                    has_selector = true;
+                } else {
+                    GEPT_ASSERT_LINE(line, false, "Unknown attribute `"HGL_SV_FMT"`\n", HGL_SV_ARG(attr.name));
+                }
+            }
+
+            /* append file */
+            append_filtered(out, content, filters, n_filters);
+            if (is_gzip) {
+                free(gunzipped.data);
+                free(gunzipped.line_offsets);
+            }
+        }
+
+        /* @csv and @json directives */
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@csv")) ||
+            hgl_sv_equals(directive, HGL_SV_LIT("@json"))) {
+            HglStringView path  = hgl_sv_lchop_until(&tokens, ' ');
+
+            /* construct NULL-terminated path... */
+            GEPT_ASSERT_LINE(line, path.length < 4096, "Path is too long");
+            memcpy(scratch_buf, path.start, path.length);
+            scratch_buf[path.length] = '\0';
+
+            HglStringBuilder row_template = read_block(&input, directive);
+            expand_table(line, out, directive, (char *) scratch_buf, tokens,
+                         hgl_sv_from_sb(&row_template));
+            hgl_sb_destroy(&row_template);
+        }
+
+        /* @bash, @python, @perl and other script directives */
+        Interpreter *interpreter = interpreter_find(directive);
+        if (interpreter != NULL) {
+            HglStringView attribute = sv_trim(tokens);
+            bool is_shared = hgl_sv_equals(attribute, HGL_SV_LIT("shared"));
+            GEPT_ASSERT_LINE(line, attribute.length == 0 || is_shared,
+                             "Unknown script attribute `"HGL_SV_FMT"`. Expected `shared`\n", HGL_SV_ARG(attribute));
+            HglStringBuilder source_code = read_block(&input, directive);
+
+            /* with `--variants`, scripts run once per variant unless they are shared */
+            if (n_variants > 0 && !is_shared) {
+                GEPT_ASSERT_LINE(line, out == output && current_parent_job == NULL,
+                                 "Scripts inside @output are shared by all variants and must be marked `shared`\n");
+                script_run_variants(line, out, interpreter, &source_code);
+            } else {
+                const char *name = (n_variants > 0) ? script_varying_name(&source_code) : NULL;
+                if (name != NULL) {
+                    fprintf(stderr, "  WARNING: shared script on line \""HGL_SV_FMT"\" mentions `%s`, "
+                            "which varies between variants and isn't defined for it\n", HGL_SV_ARG(line), name);
+                }
+                script_run(line, out, interpreter, &source_code, SIZE_MAX);
+            }
+
+            /* compiled generators keep the source, to run the script themselves */
+            if (*opt_compile == NULL) {
+                hgl_sb_destroy(&source_code);
+            }
+        }
+    }
+
+    GEPT_ASSERT(sink_depth == 0, "Missing @end for @output `%s`\n", sink_stack[sink_depth - 1]->path);
+
+    /* start the scripts of the template which fit in free slots */
+    jobs_dispatch(false);
+}
+
+/**
+ * Returns true if a line of `text` is a directive, i.e. starts with `@` when
+ * leading whitespace is ignored.
+ */
+static bool has_directive_line(HglStringView text)
+{
+    HglSliceCursor cursor = hgl_slice_cursor(hgl_slice_from_sv(text));
+    HglSlice line;
+    while (hgl_slice_cursor_next(&cursor, '\n', &line)) {
+        if (hgl_slice_starts_with_char(hgl_slice_ltrim(line), '@')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Waits for all scripts and stores their output (with `--trace-inputs`, preceded
+ * by their input manifest) in the cache. With
+ * `--expand-depth`, directives in the output of a script are expanded in memory,
+ * and scripts started by that expansion are handled the same way, up to the depth
+ * limit. Finally the output of re-expanded scripts is spliced into the output of
+ * the scripts which generated them.
+ */
+static void jobs_finish(void)
+{
+    /* `n_jobs` grows as script output is re-expanded */
+    for (size_t i = 0; i < n_jobs; i++) {
+        ScriptJob *job = jobs[i];
+        jobs_dispatch(true);
+        while (!job->done) {
+            jobs_poll(false);
+        }
+        if (job->pid != 0) {
+            history_record(job, job->seconds);
+        }
+        for (size_t j = 0; j < job->n_inputs; j++) {
+            depfile_add(job->inputs[j].path);
+        }
+        if (job->is_cacheable && *opt_trace_inputs) {
+            HglStringBuilder entry = hgl_sb_make(.initial_capacity = job->result.length + 4096);
+            trace_manifest_append(job, &entry);
+            hgl_sb_append(&entry, job->result.cstr, job->result.length);
+            cache_store(job->cache_key, entry.cstr, entry.length);
+            hgl_sb_destroy(&entry);
+        } else if (job->is_cacheable) {
+            cache_store(job->cache_key, job->result.cstr, job->result.length);
+        }
+        if (job->depth >= *opt_expand_depth || !has_directive_line(hgl_sv_from_sb(&job->result))) {
+            continue;
+        }
+
+        /* output that re-creates the output of a script it was generated by never terminates */
+        job->output_hash = hgl_hash_xxh64(job->result.cstr, job->result.length, 0);
+        for (ScriptJob *p = job->parent; p != NULL; p = p->parent) {
+            GEPT_ASSERT_LINE(job->line, p->output_hash != job->output_hash ||
+                             p->expanded_from.length != job->result.length ||
+                             memcmp(p->expanded_from.cstr, job->result.cstr, job->result.length) != 0,
+                             "Expansion cycle: the script generates the same output as a script it was generated by\n");
+        }
+
+        job->expanded_from = job->result;
+        job->result = hgl_sb_make(.initial_capacity = job->expanded_from.length + 1);
+        current_parent_job  = job;
+        current_batch_entry = job->batch_entry;
+        expand_template(hgl_sv_from_sb(&job->expanded_from), &job->result);
+        current_parent_job  = NULL;
+        current_batch_entry = SIZE_MAX;
+    }
+
+    /* jobs generated by a script come after it, so splice from the back */
+    for (size_t i = n_jobs; i-- > 0;) {
+        jobs_splice(&jobs[i]->result);
+    }
+}
+
+/**
+ * Feeds the rest of the output of the complete `stream` to its compiler, running
+ * the scripts it still waits for, and waits for the compiler to exit. The exit
+ * status of the first compiler which fails is kept in `cc_status`.
+ */
+static void cc_stream_wait(CcStream *stream)
+{
+    GEPT_ASSERT(stream->is_complete, "unreachable");
+    cc_stream_advance(stream);
+    while (stream->stdin_fd != -1) {
+        jobs_dispatch(true);
+        if (stream->stdin_fd != -1) {
+            jobs_poll(false);
+        }
+    }
+
+    pid_t wait_pid;
+    int wstatus = 0;
+    while ((wait_pid = waitpid(stream->pid, &wstatus, 0)) != stream->pid) {
+        GEPT_ASSERT(wait_pid != -1 || errno == EINTR, "waitpid() returned an error. errno=%s\n", strerror(errno));
+    }
+    stream->pid = 0;
+    int status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+    if (cc_status == 0) {
+        cc_status = status;
+    }
+}
+
+/**
+ * Starts the `--cc` compiler, with `{}` in its command line replaced by `output_path`
+ * (unless NULL), and returns a stream which feeds it `sb` as it is expanded. At most
+ * `--jobs` compilers run at a time: starting another waits for the oldest to exit.
+ */
+static CcStream *cc_stream_start(const HglStringBuilder *sb, const char *output_path)
+{
+    int64_t n_running = 0;
+    for (size_t i = 0; i < n_cc_streams; i++) {
+        n_running += (cc_streams[i]->pid != 0);
+    }
+    for (size_t i = 0; i < n_cc_streams && n_running >= max_jobs; i++) {
+        if (cc_streams[i]->pid != 0) {
+            cc_stream_wait(cc_streams[i]);
+            n_running--;
+        }
+    }
+
+    int pipe_fds[2];
+    GEPT_ASSERT(pipe2(pipe_fds, O_CLOEXEC) == 0, "Failed to create pipes");
+    pid_t pid = fork();
+    GEPT_ASSERT(pid != -1, "Call to `fork` failed. errno=%s\n", strerror(errno));
+
+    /* ======== child ======== */
+    if (pid == 0) {
+        dup2(pipe_fds[0], STDIN_FILENO);
+        signal(SIGPIPE, SIG_DFL);
+
+        size_t n_args = 0;
+        while (cc_argv[n_args] != NULL) {
+            n_args++;
+        }
+        char **exec_argv = malloc((n_args + 1) * sizeof(*exec_argv));
+        for (size_t i = 0; i < n_args; i++) {
+            HglStringBuilder arg = hgl_sb_make(.initial_capacity = 256);
+            const char *p = cc_argv[i];
+            const char *hit;
+            while (output_path != NULL && (hit = strstr(p, "{}")) != NULL) {
+                hgl_sb_append(&arg, p, hit - p);
+                hgl_sb_append_cstr(&arg, output_path);
+                p = hit + 2;
+            }
+            hgl_sb_append_cstr(&arg, p);
+            exec_argv[i] = arg.cstr;
+        }
+        exec_argv[n_args] = NULL;
+
+        /* on success `execve` doesn't return */
+        if (-1 == execvp(exec_argv[0], exec_argv)) {
+            fprintf(stderr, "ERROR (IN CHILD): failed to exec file. errno=%s\n",
+                    strerror(errno));
+            _exit(127);
+        }
+        GEPT_ASSERT(0, "unreachable");
+    }
+
+    /* ======== parent ======== */
+    close(pipe_fds[0]);
+    CcStream *stream = malloc(sizeof(*stream));
+    *stream = (CcStream) {
+        .pid      = pid,
+        .stdin_fd = pipe_fds[1],
+        .sb       = sb,
+    };
+    cc_streams = realloc(cc_streams, (n_cc_streams + 1) * sizeof(*cc_streams));
+    cc_streams[n_cc_streams++] = stream;
+    return stream;
+}
+
+/**
+ * Marks the output of `stream` as fully expanded, and writes what is final of it.
+ */
+static void cc_stream_complete(CcStream *stream)
+{
+    stream->is_complete = true;
+    cc_stream_advance(stream);
+}
+
+/**
+ * Waits for all compilers still running with `cc_stream_wait`.
+ */
+static void cc_streams_wait_all(void)
+{
+    for (size_t i = 0; i < n_cc_streams; i++) {
+        if (cc_streams[i]->pid != 0) {
+            cc_stream_wait(cc_streams[i]);
+        }
+    }
+}
+
+/**
+ * Frees all streams created by `cc_stream_start`.
+ */
+static void cc_streams_release(void)
+{
+    for (size_t i = 0; i < n_cc_streams; i++) {
+        free(cc_streams[i]);
+    }
+    free(cc_streams);
+    cc_streams   = NULL;
+    n_cc_streams = 0;
+}
+
+/**
+ * Loads the batch file at `path`. Every line holds the path of a template and the
+ * path its expansion is written to, separated by whitespace. Empty lines and lines
+ * starting with `#` are ignored.
+ */
+static void batch_load(const char *path)
+{
+    MappedFile *mf = mapped_file_get(path);
+    GEPT_ASSERT(mf != NULL, "Unable to open batch file `%s`\n", path);
+
+    HglStringView lines = hgl_sv_from(mf->data, mf->size);
+    while (lines.length > 0) {
+        HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+        HglStringView tokens = hgl_sv_ltrim(line);
+        if (tokens.length == 0 || tokens.start[0] == '#') {
+            continue;
+        }
+        HglStringView input  = hgl_sv_lchop_until(&tokens, ' ');
+        HglStringView output = hgl_sv_lchop_until(&tokens, ' ');
+        GEPT_ASSERT_LINE(line, input.length > 0 && output.length > 0, "Expected `<template> <output>`\n");
+
+        batch = realloc(batch, (n_batch + 1) * sizeof(*batch));
+        batch[n_batch++] = (BatchEntry) {
+            .input  = hgl_sv_make_cstr_copy(input, NULL),
+            .output = hgl_sv_make_cstr_copy(output, NULL),
+        };
+    }
+}
+
+/**
+ * Estimates the cost of expanding the template at `path` in seconds from its size
+ * and the number of script blocks in it. Starting an interpreter dominates the
+ * cost of most templates.
+ */
+static double batch_estimate_cost(const char *path)
+{
+    MappedFile *mf = mapped_file_get(path);
+    GEPT_ASSERT(mf != NULL, "Unable to open file `%s`\n", path);
+
+    size_t n_scripts = 0;
+    HglStringView lines = hgl_sv_from(mf->data, mf->size);
+    while (lines.length > 0) {
+        HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+        HglStringView tokens = hgl_sv_ltrim(line);
+        HglStringView directive = hgl_sv_lchop_until(&tokens, ' ');
+        if (interpreter_find(directive) != NULL) {
+            n_scripts++;
+        }
+    }
+
+    return 0.05 * (double) n_scripts + (double) mf->size / 50e6;
+}
+
+/**
+ * Reads the timing report at `path` (if it exists) into the costs of the batch
+ * entries. Entries without a measurement keep their estimated cost, scaled by how
+ * far off the estimates were for the measured entries.
+ */
+static void batch_load_timings(const char *path)
+{
+    HglStringBuilder sb = hgl_sb_make(.initial_capacity = 4096);
+    if (!read_file(path, &sb)) {
+        hgl_sb_destroy(&sb);
+        return;
+    }
+
+    double sum_estimated = 0.0;
+    double sum_measured  = 0.0;
+    HglStringView lines = hgl_sv_from_sb(&sb);
+    while (lines.length > 0) {
+        HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+        if (line.length == 0 || line.start[0] == '#') {
+            continue;
+        }
+        HglStringView tokens = line;
+        double seconds = hgl_sv_to_f64(hgl_sv_lchop_until(&tokens, ' '));
+        for (size_t i = 0; i < n_batch; i++) {
+            if (hgl_sv_equals_cstr(tokens, batch[i].output) && !batch[i].measured) {
+                sum_estimated += batch[i].cost;
+                sum_measured  += seconds;
+                batch[i].cost = seconds;
+                batch[i].measured = true;
+            }
+        }
+    }
+    hgl_sb_destroy(&sb);
+
+    if (sum_estimated > 0.0 && sum_measured > 0.0) {
+        double scale = sum_measured / sum_estimated;
+        for (size_t i = 0; i < n_batch; i++) {
+            if (!batch[i].measured) {
+                batch[i].cost *= scale;
+            }
+        }
+    }
+}
+
+/**
+ * Deterministically assigns every batch entry to one of `n_shards` shards such
+ * that the total cost of the shards is balanced, by assigning the most expensive
+ * remaining entry to the currently cheapest shard. Every shard computes the same
+ * assignment as long as they see the same batch file, templates and timings.
+ */
+static void batch_partition(int n_shards)
+{
+    size_t *order = malloc(n_batch * sizeof(*order));
+    for (size_t i = 0; i < n_batch; i++) {
+        order[i] = i;
+    }
+
+    /* sort by descending cost. Ties are broken by batch file order */
+    for (size_t i = 1; i < n_batch; i++) {
+        size_t e = order[i];
+        size_t j = i;
+        while (j > 0 && (batch[order[j - 1]].cost < batch[e].cost ||
+                         (batch[order[j - 1]].cost <= batch[e].cost && order[j - 1] > e))) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = e;
+    }
+
+    double *load = calloc(n_shards, sizeof(*load));
+    for (size_t i = 0; i < n_batch; i++) {
+        int cheapest = 0;
+        for (int shard = 1; shard < n_shards; shard++) {
+            if (load[shard] < load[cheapest]) {
+                cheapest = shard;
+            }
+        }
+        batch[order[i]].shard = cheapest;
+        load[cheapest] += batch[order[i]].cost;
+    }
+
+    free(load);
+    free(order);
+}
+
+/**
+ * Expands every batch entry assigned to `shard` into an output sink for its
+ * output path.
+ */
+static void batch_expand(int shard)
+{
+    for (size_t i = 0; i < n_batch; i++) {
+        if (batch[i].shard != shard) {
+            continue;
+        }
+
+        OutputSink *sink = output_sink_get(batch[i].output);
+        CcStream *stream = NULL;
+        if (*opt_cc) {
+            /* the compiler writes the output itself */
+            sink->is_streamed = true;
+            stream = cc_stream_start(&sink->sb, batch[i].output);
+        }
+
+        /* time spent waiting for scripts is accounted to the scripts themselves */
+        double start_time = now_seconds() - jobs_poll_seconds;
+        MappedFile *mf = mapped_file_get(batch[i].input);
+        GEPT_ASSERT(mf != NULL, "Unable to open file `%s`\n", batch[i].input);
+        current_batch_entry = i;
+        expand_template(hgl_sv_from(mf->data, mf->size), &sink->sb);
+        current_batch_entry = SIZE_MAX;
+        if (stream != NULL) {
+            cc_stream_complete(stream);
+        }
+        batch[i].seconds += now_seconds() - jobs_poll_seconds - start_time;
+    }
+}
+
+/**
+ * Merges the timings of the batch entries of `shard` into the timing report at
+ * `path`. Shards running concurrently serialize on a lock of the report, so it
+ * ends up with the timings of all of them.
+ */
+static void batch_write_timings(const char *path, int shard)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    GEPT_ASSERT(fd != -1, "Unable to open `%s`. errno=%s\n", path, strerror(errno));
+    GEPT_ASSERT(flock(fd, LOCK_EX) == 0, "Unable to lock `%s`. errno=%s\n", path, strerror(errno));
+
+    /* keep the timings of entries which were not expanded by this shard */
+    HglStringBuilder old = hgl_sb_make(.initial_capacity = 4096);
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        hgl_sb_append(&old, buf, n);
+    }
+
+    HglStringBuilder report = hgl_sb_make(.initial_capacity = 4096);
+    hgl_sb_append_cstr(&report, "# gept timings: <seconds> <output>\n");
+    HglStringView lines = hgl_sv_from(old.cstr, old.length);
+    while (lines.length > 0) {
+        HglStringView line = hgl_sv_lchop_until(&lines, '\n');
+        if (line.length == 0 || line.start[0] == '#') {
+            continue;
+        }
+        HglStringView tokens = line;
+        hgl_sv_lchop_until(&tokens, ' ');
+        bool replaced = false;
+        for (size_t i = 0; i < n_batch && !replaced; i++) {
+            replaced = (batch[i].shard == shard) && hgl_sv_equals_cstr(tokens, batch[i].output);
+        }
+        if (!replaced) {
+            hgl_sb_append_sv(&report, &line);
+            hgl_sb_append_char(&report, '\n');
+        }
+    }
+    for (size_t i = 0; i < n_batch; i++) {
+        if (batch[i].shard == shard) {
+            hgl_sb_append_fmt(&report, "%.6f %s\n", batch[i].seconds, batch[i].output);
+        }
+    }
+
+    GEPT_ASSERT(ftruncate(fd, 0) == 0 && pwrite(fd, report.cstr, report.length, 0) == (ssize_t) report.length,
+                "Failed to write `%s`. errno=%s\n", path, strerror(errno));
+    close(fd); /* releases the lock */
+
+    hgl_sb_destroy(&old);
+    hgl_sb_destroy(&report);
+}
+
+/**
+ * Frees all batch entries.
+ */
+static void batch_release(void)
+{
+    for (size_t i = 0; i < n_batch; i++) {
+        free(batch[i].input);
+        free(batch[i].output);
+    }
+    free(batch);
+    batch   = NULL;
+    n_batch = 0;
+}
+
+/**
+ * Writes `n` bytes in human-readable form to `buf`.
+ */
+static void format_size(uint64_t n, char *buf, size_t size)
+{
+    static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double x = (double) n;
+    int unit = 0;
+    while (x >= 1024.0 && unit < 4) {
+        x /= 1024.0;
+        unit++;
+    }
+    if (unit == 0) {
+        snprintf(buf, size, "%llu B", (unsigned long long) n);
+    } else {
+        snprintf(buf, size, "%.1f %s", x, units[unit]);
+    }
+}
+
+/**
+ * Predicts whether the output of a script with cache key `key` is cached, without
+ * fetching it: a local entry exists, or the remote cache has an action entry.
+ */
+static bool plan_cache_predict(const uint8_t key[32])
+{
+    char hex[65];
+    hgl_hash_to_hex(key, 32, hex);
+
+    if (*opt_cache_dir != NULL) {
+        char path[4096];
+        struct stat sb;
+        snprintf(path, sizeof(path), "%s/%.2s/%s", *opt_cache_dir, hex, hex);
+        if (stat(path, &sb) == 0) {
+            return true;
+        }
+    }
+    if (remote_cache.enabled) {
+        char path[128];
+        snprintf(path, sizeof(path), "ac/%s", hex);
+        int status = remote_cache_request("GET", path, NULL, 0, NULL);
+        if (status == 200) {
+            return true;
+        }
+        if (status != 404) {
+            remote_cache_fail("lookup");
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the size of the decompressed gzip file at `path` as recorded in its
+ * trailer, or 0 if it can't be read. The trailer holds the size modulo 2^32 of the
+ * last member only, so this is an estimate for huge or concatenated files.
+ */
+static uint64_t gzip_size_hint(const char *path)
+{
+    uint8_t trailer[4] = {0};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    off_t size = (fd == -1) ? -1 : lseek(fd, 0, SEEK_END);
+    bool ok = size >= 18 && pread(fd, trailer, sizeof(trailer), size - 4) == sizeof(trailer);
+    if (fd != -1) {
+        close(fd);
+    }
+    return ok ? (trailer[0] | (uint64_t) trailer[1] << 8 | (uint64_t) trailer[2] << 16 | (uint64_t) trailer[3] << 24) : 0;
+}
+
+/**
+ * Prints and adds to `output_min` and `output_max` the bounds of the output of
+ * embedding `size` bytes. The formatted width of a byte depends on its value.
+ */
+static void plan_embed(uint64_t size, uint64_t *output_min, uint64_t *output_max)
+{
+    embed_table_init();
+    uint64_t min_entry = UINT64_MAX;
+    uint64_t max_entry = 0;
+    for (int i = 0; i < 256; i++) {
+        uint64_t n = embed_table_offsets[i + 1] - embed_table_offsets[i];
+        min_entry = (n < min_entry) ? n : min_entry;
+        max_entry = (n > max_entry) ? n : max_entry;
+    }
+    uint64_t overhead = (size == 0) ? 0 : ((size + 19) / 20) * 5 - strlen(*opt_embed_delim);
+    uint64_t emin = size * min_entry + overhead;
+    uint64_t emax = size * max_entry + overhead;
+    *output_min += emin;
+    *output_max += emax;
+
+    char size_a[32];
+    char size_b[32];
+    format_size(emin, size_a, sizeof(size_a));
+    format_size(emax, size_b, sizeof(size_b));
+    if (emin == emax) {
+        printf("output %s", size_a);
+    } else {
+        printf("output %s..%s", size_a, size_b);
+    }
+    printf(" with --embed-fmt \"%s\"\n", *opt_embed_fmt);
+}
+
+/**
+ * Prints and adds to `output_min` and `output_max` (or, for extern arrays, to the
+ * companion source estimate of `plan`) the output of embedding `size` bytes at
+ * the site of `line`, with the `extern(NAME)`, `source(PATH)` and `shared(NAME)`
+ * attributes of `append_embed_site` and `append_embed_shared`.
+ */
+static void plan_embed_site(HglStringView line, uint64_t size, HglStringView extern_name, HglStringView source_path,
+                            HglStringView shared_name, uint64_t *output_min, uint64_t *output_max)
+{
+    char size_a[32];
+    if (shared_name.length > 0) {
+        /* the hex rows take 6 bytes per byte and 6 per row. The rest only depends on the digits of `size` */
+        uint64_t n_digits = 1;
+        for (uint64_t n = size; n >= 10; n /= 10) {
+            n_digits++;
+        }
+        uint8_t byte = 0;
+        HglStringBuilder sb = hgl_sb_make(.initial_capacity = 4096);
+        append_embed_shared(line, &sb, &byte, 1, shared_name);
+        uint64_t n = (size == 0) ? 0 : 6 * size + 6 * ((size + 19) / 20) - 3 + (sb.length - 9) + 5 * (n_digits - 1);
+        hgl_sb_destroy(&sb);
+        *output_min += n;
+        *output_max += n;
+        format_size(n, size_a, sizeof(size_a));
+        printf("output %s (shared, as hex)\n", size_a);
+        return;
+    }
+    if (extern_name.length == 0) {
+        plan_embed(size, output_min, output_max);
+        return;
+    }
+
+    /* the site gets the declarations, the companion source the definitions */
+    int n_decl = snprintf(NULL, 0, "extern const unsigned char "HGL_SV_FMT"[%llu];\nextern const size_t "HGL_SV_FMT"_len;\n",
+                          HGL_SV_ARG(extern_name), (unsigned long long) size, HGL_SV_ARG(extern_name));
+    int n_def = snprintf(NULL, 0, "const unsigned char "HGL_SV_FMT"[%llu] = {\n};\nconst size_t "HGL_SV_FMT"_len = %llu;\n\n",
+                         HGL_SV_ARG(extern_name), (unsigned long long) size, HGL_SV_ARG(extern_name),
+                         (unsigned long long) size);
+    *output_min += (uint64_t) n_decl;
+    *output_max += (uint64_t) n_decl;
+    plan.source_min += (uint64_t) n_def + ((plan.n_extern_arrays == 0) ? strlen("#include <stddef.h>\n\n") : 0);
+    plan.source_max += (uint64_t) n_def + ((plan.n_extern_arrays == 0) ? strlen("#include <stddef.h>\n\n") : 0);
+    plan.n_extern_arrays++;
+    if (source_path.length == 0 && *opt_embed_source != NULL) {
+        source_path = hgl_sv_from_cstr(*opt_embed_source);
+    }
+    format_size((uint64_t) n_decl, size_a, sizeof(size_a));
+    printf("output %s of declarations, "HGL_SV_FMT": ", size_a, HGL_SV_ARG(source_path));
+    plan_embed(size, &plan.source_min, &plan.source_max);
+}
+
+/**
+ * Prints what expanding the template `input` (read from `name`) would do, line by
+ * line, without reading more than file metadata or running any script, and adds
+ * it to the totals in `plan`. `measured_seconds` is the runtime of the template
+ * according to a timing report, or negative if there is none.
+ */
+static void plan_template(const char *name, HglStringView input, double measured_seconds)
+{
+    const char *template_start = input.start;
+    const char *counted = input.start;
+    size_t line_no = 1;
+    size_t n_scripts = 0;
+    size_t n_cache_hits = 0;
+    uint64_t output_min = 0;
+    uint64_t output_max = 0;
+    char size_a[32];
+    char size_b[32];
+
+    printf("%s:\n", name);
+
+    while (input.length > 0) {
+        HglStringView line = hgl_sv_lchop_until(&input, '\n');
+        HglStringView tokens = hgl_sv_ltrim(line);
+
+        /* regular code ==> copied as is */
+        if (!hgl_sv_starts_with(&tokens, "@")) {
+            output_min += line.length + 1;
+            output_max += line.length + 1;
+            continue;
+        }
+
+        for (; counted < line.start; counted++) {
+            line_no += (*counted == '\n');
+        }
+        printf("  %5zu  %-40.*s  ", line_no, (int) ((tokens.length < 40) ? tokens.length : 40), tokens.start);
+
+        HglStringView directive = hgl_sv_lchop_until(&tokens, ' ');
+        HglStringView path = hgl_sv_lchop_until(&tokens, ' ');
+        char cpath[4096];
+        GEPT_ASSERT_LINE(line, path.length < sizeof(cpath), "Path is too long");
+        memcpy(cpath, path.start, path.length);
+        cpath[path.length] = '\0';
+        struct stat sb;
+        bool exists = (path.length > 0) && (stat(cpath, &sb) == 0);
+        Interpreter *interpreter = interpreter_find(directive);
+
+        if (hgl_sv_equals(directive, HGL_SV_LIT("@embed"))) {
+            GEPT_ASSERT_LINE(line, exists, "Unable to open file `%s`\n", cpath);
+            uint64_t limit = SCRATCH_BUFFER_SIZE;
+            bool is_gzip = false;
+            HglStringView extern_name = {0};
+            HglStringView source_path = {0};
+            HglStringView shared_name = {0};
+            Attribute attr;
+            while (parse_attribute(line, &tokens, &attr)) {
+                if (attr.n_args != 1) {
+                    continue;
+                }
+                if (hgl_sv_equals(attr.name, HGL_SV_LIT("limit"))) {
+                    limit = hgl_sv_to_u64(attr.args[0]);
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("extern"))) {
+                    extern_name = attr.args[0];
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("source"))) {
+                    source_path = attr.args[0];
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("shared"))) {
+                    shared_name = attr.args[0];
+                }
+                is_gzip |= hgl_sv_equals(attr.name, HGL_SV_LIT("decompress"));
+            }
+
+            /* a gzip file is read as a whole, whatever the limit on its decompressed size */
+            uint64_t read_size = S_ISREG(sb.st_mode) ? (uint64_t) sb.st_size : SCRATCH_BUFFER_SIZE;
+            uint64_t size = is_gzip ? gzip_size_hint(cpath) : read_size;
+            size = (size < limit) ? size : limit;
+            read_size = is_gzip ? read_size : size;
+            plan.n_reads++;
+            plan.read_bytes += read_size;
+
+            format_size(read_size, size_a, sizeof(size_a));
+            printf("read %s, ", size_a);
+            if (is_gzip) {
+                format_size(size, size_b, sizeof(size_b));
+                printf("decompress to %s, ", size_b);
+            }
+            plan_embed_site(line, size, extern_name, source_path, shared_name, &output_min, &output_max);
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@random"))) {
+            /* the path slot holds the first attribute */
+            HglStringView attrs = hgl_sv_from(path.start, line.start + line.length - path.start);
+            uint64_t size = 0;
+            HglStringView extern_name = {0};
+            HglStringView source_path = {0};
+            Attribute attr;
+            while (parse_attribute(line, &attrs, &attr)) {
+                if (attr.n_args != 1) {
+                    continue;
+                }
+                if (hgl_sv_equals(attr.name, HGL_SV_LIT("bytes"))) {
+                    size = hgl_sv_to_u64(attr.args[0]);
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("extern"))) {
+                    extern_name = attr.args[0];
+                } else if (hgl_sv_equals(attr.name, HGL_SV_LIT("source"))) {
+                    source_path = attr.args[0];
+                }
+            }
+            printf("generate, ");
+            plan_embed_site(line, size, extern_name, source_path, (HglStringView) {0}, &output_min, &output_max);
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@include")) ||
+                   hgl_sv_equals(directive, HGL_SV_LIT("@hash"))) {
+            GEPT_ASSERT_LINE(line, exists, "Unable to open file `%s`\n", cpath);
+            bool is_include = hgl_sv_equals(directive, HGL_SV_LIT("@include"));
+            uint64_t size = (uint64_t) sb.st_size;
+            uint64_t output_size = is_include ? size : 72;
+            plan.n_reads++;
+            plan.read_bytes += size;
+            Attribute attr;
+            while (is_include && parse_attribute(line, &tokens, &attr)) {
+                if (hgl_sv_equals(attr.name, HGL_SV_LIT("decompress"))) {
+                    output_size = gzip_size_hint(cpath);
+                }
+            }
+            output_max += output_size;
+            format_size(size, size_a, sizeof(size_a));
+            format_size(output_size, size_b, sizeof(size_b));
+            printf("read %s, output <= %s\n", size_a, size_b);
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@lines"))) {
+            GEPT_ASSERT_LINE(line, exists, "Unable to open file `%s`\n", cpath);
+            /* every byte may need an escape of up to 4 characters, every line 7 more */
+            uint64_t size = (uint64_t) sb.st_size;
+            output_min += size;
+            output_max += 11 * size + 7;
+            plan.n_reads++;
+            plan.read_bytes += size;
+            format_size(size, size_a, sizeof(size_a));
+            format_size(11 * size + 7, size_b, sizeof(size_b));
+            printf("read %s, output %s..%s\n", size_a, size_a, size_b);
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@sizeof")) ||
+                   hgl_sv_equals(directive, HGL_SV_LIT("@mtime")) ||
+                   hgl_sv_equals(directive, HGL_SV_LIT("@mode")) ||
+                   hgl_sv_equals(directive, HGL_SV_LIT("@inode"))) {
+            GEPT_ASSERT_LINE(line, exists, "Unable to open file `%s`\n", cpath);
+            output_max += 24 + tokens.length;
+            printf("stat\n");
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@csv")) ||
+                   hgl_sv_equals(directive, HGL_SV_LIT("@json"))) {
+            GEPT_ASSERT_LINE(line, exists, "Unable to open file `%s`\n", cpath);
+            HglStringBuilder row_template = read_block(&input, directive);
+            hgl_sb_destroy(&row_template);
+            plan.n_reads++;
+            plan.read_bytes += (uint64_t) sb.st_size;
+            plan.n_unknown_output++;
+            format_size((uint64_t) sb.st_size, size_a, sizeof(size_a));
+            printf("read %s, output unknown (one row template per record)\n", size_a);
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@lut"))) {
+            plan.n_unknown_output++;
+            printf("generated table\n");
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@output"))) {
+            printf("output to %s\n", cpath);
+        } else if (hgl_sv_equals(directive, HGL_SV_LIT("@end"))) {
+            printf("end of output\n");
+        } else if (interpreter != NULL) {
+            HglStringBuilder source_code = read_block(&input, directive);
+            interpreter->n_planned++;
+            plan.n_scripts++;
+            n_scripts++;
+            plan.n_unknown_output++;
+            if (*opt_cache_dir != NULL || remote_cache.enabled) {
+                uint8_t cache_key[32];
+                script_cache_key(interpreter, &source_code, SIZE_MAX, cache_key);
+                bool hit = plan_cache_predict(cache_key);
+                n_cache_hits += hit;
+                printf("script, cache %s\n", hit ? "hit" : "miss");
+            } else {
+                printf("script\n");
+            }
+            hgl_sb_destroy(&source_code);
+        } else {
+            const GeptDirective *plugin_directive = plugin_directive_find(directive);
+            if (plugin_directive != NULL) {
+                if (plugin_directive->is_multiline) {
+                    HglStringBuilder body = read_block(&input, directive);
+                    hgl_sb_destroy(&body);
+                }
+                plan.n_plugin_calls++;
+                plan.n_unknown_output++;
+                printf("plugin directive\n");
+            } else {
+                printf("ignored\n");
+            }
+        }
+    }
+
+    /* same model as `batch_estimate_cost`, minus the scripts served from the cache */
+    double seconds = 0.05 * (double) (n_scripts - n_cache_hits) +
+                     (double) (input.start - template_start) / 50e6;
+    if (measured_seconds >= 0.0) {
+        seconds = measured_seconds;
+        plan.has_measured = true;
+    }
+    format_size(output_min, size_a, sizeof(size_a));
+    format_size(output_max, size_b, sizeof(size_b));
+    printf("  output %s..%s + generated output, %zu script(s), %.2f s %s\n\n", size_a, size_b,
+           n_scripts, seconds, (measured_seconds >= 0.0) ? "measured" : "estimated");
+
+    plan.n_templates++;
+    plan.output_min += output_min;
+    plan.output_max += output_max;
+    plan.n_cache_hits += n_cache_hits;
+    plan.seconds += seconds;
+}
+
+/**
+ * Prints the totals of `--plan`.
+ */
+static void plan_print_totals(void)
+{
+    char size_a[32];
+    char size_b[32];
+    printf("total:\n");
+    printf("  templates           %zu\n", plan.n_templates);
+    format_size(plan.read_bytes, size_a, sizeof(size_a));
+    printf("  files read          %zu (%s)\n", plan.n_reads, size_a);
+    format_size(plan.output_min, size_a, sizeof(size_a));
+    format_size(plan.output_max, size_b, sizeof(size_b));
+    printf("  buffered output     %s..%s + output of %zu directive(s) of unknown size\n",
+           size_a, size_b, plan.n_unknown_output);
+    if (plan.n_extern_arrays > 0) {
+        format_size(plan.source_min, size_a, sizeof(size_a));
+        format_size(plan.source_max, size_b, sizeof(size_b));
+        printf("  companion sources   %s..%s (%zu extern array(s))\n", size_a, size_b, plan.n_extern_arrays);
+    }
+    printf("  scripts             %zu (", plan.n_scripts);
+    for (size_t i = 0; i < n_interpreters; i++) {
+        printf("%s%zu %s", (i > 0) ? ", " : "", interpreters[i]->n_planned, interpreters[i]->directive);
+    }
+    printf(")\n");
+    if (*opt_cache_dir != NULL || remote_cache.enabled) {
+        printf("  cache hits          %zu (predicted)\n", plan.n_cache_hits);
+    }
+    printf("  plugin calls        %zu\n", plan.n_plugin_calls);
+    printf("  runtime             %.2f s (%s, serial)\n", plan.seconds,
+           plan.has_measured ? "from the timing report" : "estimated");
+}
+
+/* the part of a generated program (see `compile_write`) which doesn't depend on the template */
+static const char compile_runtime[] =
+"/* Runs the script of `piece`, with its output written to `fp`. Returns 0 on success */\n"
+"static int run_script(const Piece *piece, FILE *fp)\n"
+"{\n"
+"    int in[2];\n"
+"    int out[2];\n"
+"    if (pipe(in) != 0 || pipe(out) != 0) {\n"
+"        return -1;\n"
+"    }\n"
+"    fflush(fp);\n"
+"    pid_t pid = fork();\n"
+"    if (pid == -1) {\n"
+"        return -1;\n"
+"    }\n"
+"    if (pid == 0) {\n"
+"        dup2(in[0], STDIN_FILENO);\n"
+"        dup2(out[1], STDOUT_FILENO);\n"
+"        close(in[0]);\n"
+"        close(in[1]);\n"
+"        close(out[0]);\n"
+"        close(out[1]);\n"
+"        execvp(piece->argv[0], (char *const *) piece->argv);\n"
+"        fprintf(stderr, \"failed to exec `%s`: %s\\n\", piece->argv[0], strerror(errno));\n"
+"        _exit(127);\n"
+"    }\n"
+"    close(in[0]);\n"
+"    close(out[1]);\n"
+"\n"
+"    /* interpreters run their source as they read it, so output is read while it is written */\n"
+"    int in_fd = in[1];\n"
+"    size_t n_written = 0;\n"
+"    fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);\n"
+"    if (piece->size == 0) {\n"
+"        close(in_fd);\n"
+"        in_fd = -1;\n"
+"    }\n"
+"    char buf[65536];\n"
+"    for (;;) {\n"
+"        struct pollfd fds[2] = {{.fd = out[0], .events = POLLIN}, {.fd = in_fd, .events = POLLOUT}};\n"
+"        if (poll(fds, 2, -1) == -1) {\n"
+"            if (errno == EINTR) {\n"
+"                continue;\n"
+"            }\n"
+"            break;\n"
+"        }\n"
+"        if (fds[1].revents != 0) {\n"
+"            ssize_t n = write(in_fd, piece->data + n_written, piece->size - n_written);\n"
+"            if (n > 0) {\n"
+"                n_written += n;\n"
+"            }\n"
+"            if (n_written == piece->size || (n == -1 && errno != EAGAIN && errno != EINTR)) {\n"
+"                close(in_fd);\n"
+"                in_fd = -1;\n"
+"            }\n"
+"        }\n"
+"        if (fds[0].revents != 0) {\n"
+"            ssize_t n = read(out[0], buf, sizeof(buf));\n"
+"            if (n > 0) {\n"
+"                fwrite(buf, 1, n, fp);\n"
+"            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {\n"
+"                break;\n"
+"            }\n"
+"        }\n"
+"    }\n"
+"    if (in_fd != -1) {\n"
+"        close(in_fd);\n"
+"    }\n"
+"    close(out[0]);\n"
+"\n"
+"    int status;\n"
+"    while (waitpid(pid, &status, 0) == -1) {\n"
+"        if (errno != EINTR) {\n"
+"            return -1;\n"
+"        }\n"
+"    }\n"
+"    /* a script which didn't read all of its source failed too */\n"
+"    return (n_written == piece->size && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;\n"
+"}\n"
+"\n"
+"int main(int argc, char *argv[])\n"
+"{\n"
+"    /* a script which fails before reading its source is reported below */\n"
+"    signal(SIGPIPE, SIG_IGN);\n"
+"\n"
+"    /* NAME=VALUE arguments are passed to the scripts as environment variables */\n"
+"    for (int i = 1; i < argc; i++) {\n"
+"        if (strchr(argv[i], '=') == NULL || putenv(argv[i]) != 0) {\n"
+"            fprintf(stderr, \"Usage: %s [NAME=VALUE]...\\n\", argv[0]);\n"
+"            return 1;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    for (size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++) {\n"
+"        FILE *fp = stdout;\n"
+"        if (outputs[i].path != NULL && (fp = fopen(outputs[i].path, \"wb\")) == NULL) {\n"
+"            fprintf(stderr, \"Unable to open `%s` for writing: %s\\n\", outputs[i].path, strerror(errno));\n"
+"            return 1;\n"
+"        }\n"
+"        for (size_t j = 0; j < outputs[i].n_pieces; j++) {\n"
+"            const Piece *piece = &outputs[i].pieces[j];\n"
+"            if (piece->argv == NULL) {\n"
+"                fwrite(piece->data, 1, piece->size, fp);\n"
+"            } else if (run_script(piece, fp) != 0) {\n"
+"                fprintf(stderr, \"Script `%s` failed\\n\", piece->line);\n"
+"                return 1;\n"
+"            }\n"
+"        }\n"
+"        if (fflush(fp) != 0 || ferror(fp) || (fp != stdout && fclose(fp) != 0)) {\n"
+"            fprintf(stderr, \"Failed to write `%s`\\n\", outputs[i].path ? outputs[i].path : \"stdout\");\n"
+"            return 1;\n"
+"        }\n"
+"    }\n"
+"    return 0;\n"
+"}\n";
+
+/**
+ * Appends `size` bytes of `data` as a C string literal, split into one literal per
+ * line of `data`.
+ */
+static void compile_append_text(HglStringBuilder *c, const char *data, size_t size)
+{
+    if (size == 0) {
+        hgl_sb_append_cstr(c, "\"\"");
+    }
+    while (size > 0) {
+        const char *nl = memchr(data, '\n', size);
+        size_t n = (nl == NULL) ? size : (size_t) (nl - data) + 1;
+        hgl_sb_append_cstr(c, "\n    ");
+        append_c_string(c, data, n);
+        data += n;
+        size -= n;
+    }
+}
+
+/**
+ * Appends the pieces of output `o`, whose expansion is `sb`, to the generated
+ * program `c`: the text between scripts as static data, and the scripts, which are
+ * run by the program. Returns the number of pieces.
+ */
+static size_t compile_output(HglStringBuilder *c, size_t o, HglStringBuilder *sb)
+{
+    HglStringBuilder pieces = hgl_sb_make(.initial_capacity = 4096);
+    size_t n_pieces = 0;
+    size_t prev_offset = 0;
+    for (size_t i = 0; i <= n_jobs; i++) {
+        ScriptJob *job = (i < n_jobs) ? jobs[i] : NULL;
+        if (job != NULL && job->sink != sb) {
+            continue;
+        }
+
+        /* text up to the script */
+        size_t offset = (job != NULL) ? job->offset : sb->length;
+        if (offset > prev_offset) {
+            hgl_sb_append_fmt(c, "static const char text_%zu_%zu[] =", o, n_pieces);
+            compile_append_text(c, sb->cstr + prev_offset, offset - prev_offset);
+            hgl_sb_append_cstr(c, ";\n\n");
+            hgl_sb_append_fmt(&pieces, "    {text_%zu_%zu, sizeof(text_%zu_%zu) - 1, NULL, NULL},\n",
+                              o, n_pieces, o, n_pieces);
+            n_pieces++;
+        }
+        prev_offset = offset;
+        if (job == NULL) {
+            break;
+        }
+
+        /* the script */
+        char *exec_argv[32];
+        script_argv(job->interpreter, exec_argv);
+        hgl_sb_append_fmt(c, "static const char *const argv_%zu_%zu[] = {", o, n_pieces);
+        for (int k = 0; exec_argv[k] != NULL; k++) {
+            append_c_string(c, exec_argv[k], strlen(exec_argv[k]));
+            hgl_sb_append_cstr(c, ", ");
+        }
+        hgl_sb_append_cstr(c, "NULL};\n");
+        hgl_sb_append_fmt(c, "static const char script_%zu_%zu[] =", o, n_pieces);
+        compile_append_text(c, job->source.cstr, job->source.length);
+        hgl_sb_append_cstr(c, ";\n\n");
+        hgl_sb_append_fmt(&pieces, "    {script_%zu_%zu, sizeof(script_%zu_%zu) - 1, argv_%zu_%zu, ",
+                          o, n_pieces, o, n_pieces, o, n_pieces);
+        append_c_string(&pieces, job->line.start, job->line.length);
+        hgl_sb_append_cstr(&pieces, "},\n");
+        n_pieces++;
+    }
+
+    hgl_sb_append_fmt(c, "static const Piece pieces_%zu[] = {\n", o);
+    if (n_pieces == 0) {
+        hgl_sb_append_cstr(c, "    {\"\", 0, NULL, NULL},\n");
+        n_pieces = 1;
+    }
+    hgl_sb_append(c, pieces.cstr, pieces.length);
+    hgl_sb_append_cstr(c, "};\n\n");
+    hgl_sb_destroy(&pieces);
+    return n_pieces;
+}
+
+/**
+ * Writes a standalone C program to `path`, which writes the expansion `output` of
+ * the template to stdout and the output files to their paths, like GEPT itself
+ * would. Everything but scripts is expanded now, so the program mostly copies
+ * static data. Scripts are run by the program, with its NAME=VALUE arguments in
+ * their environment.
+ */
+static void compile_write(const char *path, HglStringBuilder *output)
+{
+    /* gept terminates stdout with a newline */
+    hgl_sb_append_char(output, '\n');
+
+    HglStringBuilder c = hgl_sb_make(.initial_capacity = 2 * output->length + 8192);
+    hgl_sb_append_fmt(&c,
+        "/*\n"
+        " * Generated by `gept --compile` from `%s`. Do not edit.\n"
+        " *\n"
+        " * Writes the expansion of the template. Scripts are run with every NAME=VALUE\n"
+        " * argument in their environment:\n"
+        " *\n"
+        " *     cc -O2 gen.c -o gen && ./gen [NAME=VALUE]...\n"
+        " */\n"
+        "\n"
+        "#define _GNU_SOURCE\n"
+        "\n"
+        "#include <errno.h>\n"
+        "#include <fcntl.h>\n"
+        "#include <poll.h>\n"
+        "#include <signal.h>\n"
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "#include <string.h>\n"
+        "#include <unistd.h>\n"
+        "#include <sys/wait.h>\n"
+        "\n"
+        "typedef struct {\n"
+        "    const char *data;         /* static text, or the source code of a script */\n"
+        "    size_t size;\n"
+        "    const char *const *argv;  /* command line running the script. NULL for static text */\n"
+        "    const char *line;         /* directive line of the script, for error messages */\n"
+        "} Piece;\n"
+        "\n"
+        "typedef struct {\n"
+        "    const char *path;         /* NULL for stdout */\n"
+        "    const Piece *pieces;\n"
+        "    size_t n_pieces;\n"
+        "} Output;\n"
+        "\n", *opt_infile);
+
+    /* output files first, then stdout, in the order GEPT writes them */
+    size_t *n_pieces = malloc((n_output_sinks + 1) * sizeof(*n_pieces));
+    for (size_t i = 0; i < n_output_sinks; i++) {
+        n_pieces[i] = compile_output(&c, i, &output_sinks[i]->sb);
+    }
+    n_pieces[n_output_sinks] = compile_output(&c, n_output_sinks, output);
+
+    hgl_sb_append_cstr(&c, "static const Output outputs[] = {\n");
+    for (size_t i = 0; i <= n_output_sinks; i++) {
+        hgl_sb_append_cstr(&c, "    {");
+        if (i < n_output_sinks) {
+            append_c_string(&c, output_sinks[i]->path, strlen(output_sinks[i]->path));
+        } else {
+            hgl_sb_append_cstr(&c, "NULL");
+        }
+        hgl_sb_append_fmt(&c, ", pieces_%zu, %zu},\n", i, n_pieces[i]);
+    }
+    hgl_sb_append_cstr(&c, "};\n\n");
+    hgl_sb_append_cstr(&c, compile_runtime);
+    free(n_pieces);
+
+    FILE *fp = fopen(path, "wb");
+    GEPT_ASSERT(fp != NULL, "Unable to open `%s` for writing. errno=%s\n", path, strerror(errno));
+    size_t n_written_bytes = fwrite(c.cstr, 1, c.length, fp);
+    GEPT_ASSERT(n_written_bytes == c.length && fclose(fp) == 0,
+                "Failed to write `%s`. errno=%s\n", path, strerror(errno));
+    hgl_sb_destroy(&c);
+}
+
+/**
+ * Appends `path` to the depfile `sb`, escaped for make.
+ */
+static void depfile_append_path(HglStringBuilder *sb, const char *path)
+{
+    for (const char *c = path; *c != '\0'; c++) {
+        if (*c == ' ' || *c == '#') {
+            hgl_sb_append_char(sb, '\\');
+        } else if (*c == '$') {
+            hgl_sb_append_char(sb, '$');
+        }
+        hgl_sb_append_char(sb, *c);
+    }
+}
+
+/**
+ * Writes a make-style depfile to `path`, with a rule making every output file
+ * depend on every regular file read while expanding: the template(s), files read
+ * by directives and, with `--trace-inputs`, files read by scripts. Output written
+ * to stdout is named after the depfile, with its `.d` suffix removed.
+ */
+static void depfile_write(const char *path)
+{
+    HglStringBuilder sb = hgl_sb_make(.initial_capacity = 4096);
+    size_t n_targets = 0;
+    for (size_t i = 0; i < n_output_sinks; i++) {
+        depfile_append_path(&sb, output_sinks[i]->path);
+        hgl_sb_append_char(&sb, ' ');
+        n_targets++;
+    }
+    size_t length = strlen(path);
+    if (*opt_batch == NULL && n_variants == 0 && length > 2 && strcmp(path + length - 2, ".d") == 0) {
+        char *stdout_target = strndup(path, length - 2);
+        depfile_append_path(&sb, stdout_target);
+        hgl_sb_append_char(&sb, ' ');
+        free(stdout_target);
+        n_targets++;
+    }
+    GEPT_ASSERT(n_targets > 0, "--depfile needs an output file: name the depfile `OUT.d` when writing OUT "
+                "to stdout, or use @output or --batch\n");
+    sb.cstr[sb.length - 1] = ':';
+
+    /* mapped files include the templates of a batch */
+    size_t n_candidates = 1 + n_mapped_files + n_file_stats + n_depfile_inputs;
+    const char **candidates = malloc(n_candidates * sizeof(*candidates));
+    size_t n = 0;
+    candidates[n++] = (*opt_batch == NULL) ? *opt_infile : *opt_batch;
+    for (size_t i = 0; i < n_mapped_files; i++) {
+        candidates[n++] = mapped_files[i]->path;
+    }
+    for (size_t i = 0; i < n_file_stats; i++) {
+        candidates[n++] = file_stats[i].path;
+    }
+    for (size_t i = 0; i < n_depfile_inputs; i++) {
+        candidates[n++] = depfile_inputs[i];
+    }
+
+    /* make can only depend on files which exist */
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        bool is_listed = false;
+        for (size_t j = 0; j < i && !is_listed; j++) {
+            is_listed = (strcmp(candidates[i], candidates[j]) == 0);
+        }
+        if (is_listed || stat(candidates[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        hgl_sb_append_cstr(&sb, " \\\n  ");
+        depfile_append_path(&sb, candidates[i]);
+    }
+    hgl_sb_append_char(&sb, '\n');
+    free(candidates);
+
+    GEPT_ASSERT(write_file_atomic(path, sb.cstr, sb.length),
+                "Unable to write depfile `%s`. errno=%s\n", path, strerror(errno));
+    hgl_sb_destroy(&sb);
+}
+
+int main(int argc, char *argv[])
+{
+    int err;
+
+    /* parse cli arguments */
+    opt_infile        = hgl_flags_add_str("-i,--input", "Input file path", NULL, 0);
+    opt_firejail_path = hgl_flags_add_str("--firejail-path", "Alternative path to the firejail executable", NULL, 0);
+    opt_python_path   = hgl_flags_add_str("--python-path", "Alternative path to the python3 executable", NULL, 0);
+    opt_perl_path     = hgl_flags_add_str("--perl-path", "Alternative path to the perl executable", NULL, 0);
+    opt_bash_path     = hgl_flags_add_str("--bash-path", "Alternative path to the bash executable", NULL, 0);
+    opt_embed_fmt     = hgl_flags_add_str("--embed-fmt", "C-style format string used by the @embed directive.", "0x%02X", 0);
+    opt_embed_delim   = hgl_flags_add_str("--embed-delim", "Delimiter string used by the @embed directive", ", ", 0);
+    opt_embed_source  = hgl_flags_add_str("--embed-source", "Companion source file for `@embed <file> extern(NAME)` definitions", NULL, 0);
+    opt_jobs          = hgl_flags_add_i64_range("-j,--jobs", "Maximum number of scripts run in parallel. Defaults to 1, or to what the make jobserver allows when run by make", 0, 0, 0, 1024);
+    opt_batch         = hgl_flags_add_str("--batch", "Expand every `<template> <output>` pair listed in the given file", NULL, 0);
+    opt_variants      = hgl_flags_add_str("--variants", "Write an output for every `<output> [NAME=VALUE]...` variant listed in the given file, expanding the template once", NULL, 0);
+    opt_shard         = hgl_flags_add_str("--shard", "Only expand shard I/N (0 <= I < N) of the batch, balanced by estimated cost", NULL, 0);
+    opt_timings       = hgl_flags_add_str("--timings", "Timing report of a previous run, used to balance the shards", NULL, 0);
+    opt_timings_out   = hgl_flags_add_str("--timings-out", "Timing report the timings of this run are merged into", NULL, 0);
+    opt_history       = hgl_flags_add_str("--history", "Directory of per-template script durations, used to start the longest scripts first", NULL, 0);
+    opt_plugins       = hgl_flags_add_str("--plugin", "Comma-separated list of plugins (shared objects) to load", NULL, 0);
+    opt_cache_dir     = hgl_flags_add_str("--cache-dir", "Directory in which script outputs are cached", NULL, 0);
+    opt_remote_cache  = hgl_flags_add_str("--remote-cache", "URL (http://host[:port][/prefix]) of a shared HTTP cache for script outputs", NULL, 0);
+    opt_remote_cache_timeout = hgl_flags_add_i64_range("--remote-cache-timeout", "Timeout of remote cache operations in milliseconds", 2000, 0, 1, 600000);
+    opt_expand_depth  = hgl_flags_add_i64_range("--expand-depth", "Expand directives in script output, up to this many levels deep (0 = off)", 0, 0, 0, 64);
+    opt_compile       = hgl_flags_add_str("--compile", "Write a standalone C program to the given path, which writes the expansion of the template", NULL, 0);
+    opt_cc            = hgl_flags_add_bool("--cc", "Stream the expansion into the stdin of the compiler command following `--`, e.g. `--cc -- gcc -c -x c - -o out.o`. With --batch, `{}` in the command is replaced by the output path", false, 0);
+    opt_interp        = hgl_flags_add_str("--interp", "Script interpreters: `name=command line` entries separated by `;`, or `@FILE` with one per line", NULL, 0);
+    opt_stats         = hgl_flags_add_bool("--stats", "Print how many scripts every interpreter ran and how long they took to stderr", false, 0);
+    opt_trace_inputs  = hgl_flags_add_bool("--trace-inputs", "Record the files every script reads, and only reuse cached output while they are unchanged (needs --yolo)", false, 0);
+    opt_depfile       = hgl_flags_add_str("--depfile", "Write a make-style depfile, listing the files the expansion read, to the given path", NULL, 0);
+    opt_plan          = hgl_flags_add_bool("--plan", "Report what expanding the template(s) would read, run and output, without doing it", false, 0);
+    opt_yolo          = hgl_flags_add_bool("-yolo, --yolo", "Enable YOLO-mode. Run @python, @perl, and @bash in a non-sandboxed environment.", false, 0);
+    opt_help          = hgl_flags_add_bool("-h,--help", "Displays this help message", false, 0);
+
+    /* the compiler command line of --cc follows `--` */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            cc_argv = &argv[i + 1];
+            argc    = i;
+            break;
+        }
+    }
+
+    err = hgl_flags_parse(argc, argv);
+    if (err != 0 || *opt_help || (*opt_infile == NULL) == (*opt_batch == NULL)) {
+        printf("GEPT - [GE]neric [P]rogrammable [T]emplates\n");
+        printf("Usage: %s [Options]\n", argv[0]);
+        hgl_flags_print();
+        return 1;
+    }
+
+    /* use the make jobserver if available, unless told otherwise */
+    jobserver_init();
+    if (*opt_jobs > 0) {
+        max_jobs = *opt_jobs;
+    } else if (jobserver.read_fd != -1) {
+        max_jobs = INT64_MAX;
+    }
+
+    if (*opt_remote_cache != NULL) {
+        remote_cache_init(*opt_remote_cache);
+    }
+    interpreters_init(*opt_interp);
+    if (*opt_plugins != NULL) {
+        plugins_load(*opt_plugins);
+    }
+    GEPT_ASSERT(*opt_compile == NULL || (*opt_batch == NULL && *opt_expand_depth == 0 && !*opt_plan),
+                "--compile can't be combined with --batch, --expand-depth or --plan\n");
+    if (*opt_variants != NULL) {
+        GEPT_ASSERT(*opt_batch == NULL && *opt_compile == NULL && *opt_expand_depth == 0 && !*opt_plan,
+                    "--variants can't be combined with --batch, --compile, --expand-depth or --plan\n");
+        variants_load(*opt_variants);
+    }
+    if (*opt_cc) {
+        GEPT_ASSERT(cc_argv != NULL && cc_argv[0] != NULL, "--cc needs a compiler command following `--`\n");
+        GEPT_ASSERT(*opt_compile == NULL && *opt_variants == NULL && *opt_expand_depth == 0 && !*opt_plan,
+                    "--cc can't be combined with --compile, --variants, --expand-depth or --plan\n");
+        /* a compiler which exits early is reported by its exit status */
+        signal(SIGPIPE, SIG_IGN);
+    } else {
+        GEPT_ASSERT(cc_argv == NULL, "Unexpected `--`: only --cc takes a command line\n");
+    }
+#ifdef TRACE_AUDIT_ARCH
+    /* traced scripts run with no_new_privs, which keeps the setuid firejail from sandboxing them */
+    GEPT_ASSERT(!*opt_trace_inputs || (*opt_yolo && *opt_compile == NULL),
+                "--trace-inputs requires --yolo, and can't be combined with --compile\n");
+#else
+    GEPT_ASSERT(!*opt_trace_inputs, "--trace-inputs is not supported on this platform\n");
+#endif
+
+    int devnull = open("/dev/null", O_WRONLY);
+    GEPT_ASSERT(devnull != - 1, "Unable to open /dev/null for writing.\n");
+
+    /* Check that firejail is installed if not running in YOLO-mode. */
+    if (!*opt_yolo && !*opt_plan && *opt_compile == NULL) {
+        pid_t pid = fork();
+
+        /* ======== child ======== */
+        if (pid == 0) {
+            /* redirect stdout to the void */
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+            char *exec_argv[3];
+            exec_argv[0] = "which";
+            exec_argv[1] = (*opt_firejail_path == NULL) ? "firejail": *opt_firejail_path;
+            exec_argv[2] = NULL;
+#pragma GCC diagnostic pop
+
+            /* on success `execve` doesn't return */
+            if (-1 == execvp(exec_argv[0], exec_argv)) {
+                fprintf(stderr, "ERROR (IN CHILD): failed to exec file. errno=%s\n",
+                        strerror(errno));
+                exit(1);
+            }
+            GEPT_ASSERT(0, "unreachable");
+        }
+
+        /* wait for process to terminate */
+        pid_t wait_pid;
+        int wstatus = 0;
+        while ((wait_pid = waitpid(pid, &wstatus, 0)) != pid) {
+            GEPT_ASSERT(wait_pid != -1, "waitpid() returned an error. errno=%s\n", strerror(errno));
+        }
+        if (WEXITSTATUS(wstatus) != 0) {
+            fprintf(stderr, "Error: GEPT could not find a firejail executable installed on \n"); 
+            fprintf(stderr, "       your system. Please make sure firejail is installed or, \n");
+            fprintf(stderr, "       if you know what you're doing, run GEPT in \"YOLO mode\" \n");
+            fprintf(stderr, "       by passing the `--yolo` option. \n");
+            exit(1);
+        }
+    }
+
+    HglStringView input;
+    HglStringBuilder output = hgl_sb_make(.initial_capacity = 4096);
+    HglStringBuilder input_sb = hgl_sb_make(.initial_capacity = 4096);
+    int shard = 0;
+    if (*opt_batch != NULL) {
+        /* which shard of the batch is ours? */
+        int n_shards = 1;
+        if (*opt_shard != NULL) {
+            HglStringView sv = hgl_sv_from_cstr(*opt_shard);
+            shard    = (int) hgl_sv_lchop_u64(&sv);
+            bool ok  = hgl_sv_lchop_if_starts_with(&sv, "/");
+            n_shards = (int) hgl_sv_lchop_u64(&sv);
+            GEPT_ASSERT(ok && sv.length == 0 && n_shards > 0 && shard < n_shards,
+                        "Invalid shard `%s`. Expected I/N with 0 <= I < N\n", *opt_shard);
+        }
+        GEPT_ASSERT(*opt_timings == NULL || *opt_timings_out == NULL || strcmp(*opt_timings, *opt_timings_out) != 0,
+                    "--timings and --timings-out must differ, or concurrent shards may partition differently\n");
+
+        /* partition and expand templates */
+        batch_load(*opt_batch);
+        for (size_t i = 0; i < n_batch; i++) {
+            batch[i].cost = batch_estimate_cost(batch[i].input);
+        }
+        if (*opt_timings != NULL) {
+            batch_load_timings(*opt_timings);
+        }
+        batch_partition(n_shards);
+        if (*opt_plan) {
+            for (size_t i = 0; i < n_batch; i++) {
+                if (batch[i].shard == shard) {
+                    MappedFile *mf = mapped_file_get(batch[i].input);
+                    GEPT_ASSERT(mf != NULL, "Unable to open file `%s`\n", batch[i].input);
+                    plan_template(batch[i].input, hgl_sv_from(mf->data, mf->size),
+                                  batch[i].measured ? batch[i].cost : -1.0);
+                }
+            }
+        } else {
+            batch_expand(shard);
+        }
+    } else {
+        /* open template file */
+        err = hgl_sb_append_file(&input_sb, *opt_infile);
+        GEPT_ASSERT(err == 0, "Call to `hgl_sb_append_file` failed.\n");
+        input = hgl_sv_from_sb(&input_sb);
+
+        /* generate output */
+        if (*opt_plan) {
+            plan_template(*opt_infile, input, -1.0);
+        } else {
+            CcStream *stream = *opt_cc ? cc_stream_start(&output, NULL) : NULL;
+            expand_template(input, &output);
+            if (stream != NULL) {
+                hgl_sb_append_char(&output, '\n'); /* like the output printed to stdout */
+                cc_stream_complete(stream);
+            }
+        }
+    }
+
+    if (*opt_plan) {
+        plan_print_totals();
+    } else if (*opt_compile != NULL) {
+        compile_write(*opt_compile, &output);
+    } else {
+        /* splice in script output */
+        jobs_finish();
+        cc_streams_wait_all();
+        for (size_t i = 0; i < n_output_sinks; i++) {
+            jobs_splice(&output_sinks[i]->sb);
+        }
+        if (n_variants > 0) {
+            /* every variant gets the shared output, with its own scripts spliced in */
+            for (size_t i = 0; i < n_variants; i++) {
+                jobs_splice_to(&output, i, &output_sink_get(variants[i].output)->sb);
+            }
+        } else {
+            jobs_splice(&output);
+        }
+
+        /* write output files */
+        output_sinks_flush();
+        if (*opt_depfile != NULL) {
+            depfile_write(*opt_depfile);
+        }
+        if (*opt_history != NULL) {
+            histories_write();
+        }
+
+        if (*opt_batch != NULL) {
+            if (*opt_timings_out != NULL) {
+                batch_write_timings(*opt_timings_out, shard);
+            }
+        } else if (n_variants == 0 && !*opt_cc) {
+            /* print output to stdout */
+            printf(HGL_SB_FMT "\n", HGL_SB_ARG(output));
+        }
+        if (*opt_stats) {
+            interpreters_print_stats();
+        }
+    }
+
+    /* cleanup */
+    hgl_sb_destroy(&input_sb);
+    hgl_sb_destroy(&output);
+    mapped_files_release();
+    file_stats_release();
+    regexes_release();
+    output_sinks_release();
+    jobs_release();
+    batch_release();
+    cc_streams_release();
+    variants_release();
+    histories_release();
+    remote_cache_release();
+    plugins_release();
+    interpreters_release();
+    for (size_t i = 0; i < n_depfile_inputs; i++) {
+        free(depfile_inputs[i]);
+    }
+    free(depfile_inputs);
+    if (embed_table.cstr != NULL) {
+        hgl_sb_destroy(&embed_table);
+    }
+
+    close(devnull);
+
+    /* with --cc, fail like the compiler did */
+    return cc_status;
 }
 
 // TODO: Better error messages. Especially when subprocesses fail.